@@ -0,0 +1,209 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Bots: drivers for the cars nobody is at the keys of.
+ */
+
+#include "bot.h"
+#include <algorithm>
+
+const bot_tier bot_tiers[BOT_TIERS] =
+{
+	{"careful", {48, 36, 12, 4, 20}},
+	{"steady", {32, 20, 6, 2, 12}},
+	{"reckless", {24, 8, 2, 1, 6}},
+};
+
+const search_settings search_default = {8, 16, 24};
+
+const int bot_commands[BOT_COMMANDS][2] =
+{
+	{0, 0}, {ACCELERATE, 0}, {BRAKE, 0},
+	{0, LEFT}, {0, RIGHT}, {ACCELERATE, LEFT}, {ACCELERATE, RIGHT}, {BRAKE, LEFT}, {BRAKE, RIGHT},
+};
+
+steering_bot::steering_bot(const bot_settings& chosen)
+{
+	settings = chosen;
+}
+
+int steering_bot::_lane(race* contest, int index, int offset)
+{
+	const zr_car& car = contest->get_car(index);
+	track* course = contest->get_course(index);
+	const int size = contest->get_config().car_size;
+	int left = car.x + offset;
+
+	if(left < 0 || course->get_width() < left+size)
+		return -size;
+	/*
+	 * From the car's bottom row up, whatever is next to the car's image
+	 * in its square is in the way too, as it's going to move up.
+	 */
+	int clear = contest->clearance(index, car.y+size-1, left, left+size-1, settings.range+size);
+	// Clear all the way to the finish is as good as it gets.
+	if(clear >= car.y+size)
+		clear = settings.range+size;
+	return clear - size;
+}
+
+void steering_bot::drive(race* contest, int index)
+{
+	// The lane clear for the longest, the nearest of those, if it's worth the swerve.
+	int ahead = _lane(contest, index, 0);
+	int target = 0, most = ahead + settings.swerve;
+	for(int i = 1; i<=settings.reach; i++)
+		for(int side = -1; side<=1; side += 2)
+		{
+			int clear = _lane(contest, index, side*i);
+			if(clear > most)
+			{
+				target = side*i;
+				most = clear;
+			}
+		}
+	// How fast depends on the lane the car gets into next.
+	int x = target > 0 ? RIGHT : target < 0 ? LEFT : 0;
+	if(x)
+		ahead = _lane(contest, index, x);
+
+	int y = 0;
+	if(ahead > settings.accelerate)
+		y = ACCELERATE;
+	else if(ahead < settings.brake)
+		y = BRAKE;
+	contest->command(index, y, x, contest->get_time());
+}
+
+search_bot::search_bot(const search_settings& chosen)
+{
+	settings = chosen;
+	settings.beam = max(settings.beam, 1);
+	// A move of the beam is all the nodes there ever are at a time, the swaps keep the room.
+	ways.reserve(settings.beam*BOT_COMMANDS);
+	next.reserve(settings.beam*BOT_COMMANDS);
+	ahead.resize((2*settings.depth+1)*(2*settings.depth+1));
+}
+
+int search_bot::_score(race* contest, int index, const zr_car& car)
+{
+	if(car.status == ZR_FINISHED)
+		return INF - car.finish_time;
+	int& clear = ahead[(car.y-ahead_y)*(2*settings.depth+1) + car.x-ahead_x];
+	if(clear < 0)
+	{
+		const int size = contest->get_config().car_size;
+		clear = contest->clearance(index, car.y+size-1, car.x, car.x+size-1, settings.range+size) - size;
+		if(clear >= car.y)
+			clear = settings.range;
+	}
+	// A line further is worth a line of road ahead, and a step sooner a line too.
+	return clear - 2*car.y - car.last_move;
+}
+
+bool search_bot::_better(const node& a, const node& b)
+{
+	// Down to the last field, so the order doesn't depend on the sort.
+	if(a.score != b.score)
+		return a.score > b.score;
+	if(a.car.y != b.car.y)
+		return a.car.y < b.car.y;
+	if(a.car.x != b.car.x)
+		return a.car.x < b.car.x;
+	if(a.car.last_move != b.car.last_move)
+		return a.car.last_move < b.car.last_move;
+	if(a.car.top_line != b.car.top_line)
+		return a.car.top_line < b.car.top_line;
+	return a.first < b.first;
+}
+
+void search_bot::drive(race* contest, int index)
+{
+	const zr_car& car = contest->get_car(index);
+
+	ahead_y = car.y - 2*settings.depth;
+	ahead_x = car.x - settings.depth;
+	fill(ahead.begin(), ahead.end(), -1);
+
+	node start;
+	start.car = car;
+	start.first = 0;
+	start.score = 0;
+	ways.assign(1, start);
+	for(int depth = 0; depth<settings.depth; depth++)
+	{
+		next.clear();
+		for(unsigned i = 0; i<ways.size(); i++)
+		{
+			// A finished way has nowhere further to go.
+			if(ways[i].car.status == ZR_FINISHED)
+			{
+				next.push_back(ways[i]);
+				continue;
+			}
+			for(int j = 0; j<BOT_COMMANDS; j++)
+			{
+				node n = ways[i];
+				n.car.command_y = bot_commands[j][0];
+				n.car.command_x = bot_commands[j][1];
+				if(!depth)
+					n.first = j;
+				if(contest->advance(index, n.car) == ZR_CRASHED)
+					continue;
+				n.score = _score(contest, index, n.car);
+				next.push_back(n);
+			}
+		}
+		// If every way crashes, the best of the ones before is as good as it gets.
+		if(next.empty())
+			break;
+
+		// The best ones, each place only once, however the car got there.
+		sort(next.begin(), next.end(), _better);
+		unsigned kept = 0;
+		for(unsigned i = 0; i<next.size() && (int)kept<settings.beam; i++)
+		{
+			const zr_car& a = next[i].car;
+			if(kept)
+			{
+				const zr_car& b = next[kept-1].car;
+				if(a.y == b.y && a.x == b.x && a.last_move == b.last_move && a.top_line == b.top_line)
+					continue;
+			}
+			next[kept++] = next[i];
+		}
+		next.resize(kept);
+		ways.swap(next);
+	}
+
+	const int* chosen = bot_commands[ways[0].first];
+	contest->command(index, chosen[0], chosen[1], contest->get_time());
+}
+
+void drive_bots(race* contest, bot* const* bots)
+{
+	for(int i = 0; i<contest->get_cars(); i++)
+		if(bots[i] && contest->due(i))
+			bots[i]->drive(contest, i);
+}
+
+zr_car solo_heat(const zr_config* chosen, unsigned int seed, bot* driver, int* steps)
+{
+	zr_config config = *chosen;
+	config.players = 1;
+	config.shared_track = config.similar_track = 0;
+	race contest(&config, seed);
+	bot* drivers[1] = {driver};
+	int limit = STEPS_PER_LINE*config.race_length*config.laps;
+	*steps = 0;
+	do
+	{
+		drive_bots(&contest, drivers);
+		++*steps;
+	}
+	while(contest.step() && *steps < limit);
+	contest.retire(0);
+	return contest.get_car(0);
+}
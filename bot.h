@@ -0,0 +1,143 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Bots: drivers for the cars nobody is at the keys of.
+ *
+ * A bot is asked for a command whenever its car is about to move and
+ * gives it the way a player would, through race::command(). It goes by
+ * what's ahead of the car on the track, the cars and movers included,
+ * and by nothing a player couldn't see on the screen.
+ */
+
+#ifndef BOT_H
+#define BOT_H
+
+#include "engine.h"
+
+// What a steering bot drives by, the numbers are lines of clear road ahead.
+struct bot_settings
+{
+	// How far ahead it looks.
+	int range;
+	// It speeds up with more clear road ahead than this, and slows down with less than that.
+	int accelerate, brake;
+	// How many lines more another lane has to offer before the bot steers towards it.
+	int swerve;
+	// How many columns to either side it looks for a better lane.
+	int reach;
+};
+
+// Every command a bot can give, as y and x, keeping on as it is first.
+#define BOT_COMMANDS 9
+
+extern const int bot_commands[BOT_COMMANDS][2];
+
+class bot
+{
+	public:
+	virtual ~bot(void) {}
+	// Gives the car its command for the next move.
+	virtual void drive(race*, int) = 0;
+};
+
+/*
+ * Looks at the lanes the width of the car ahead of it, the one it's in
+ * and a few to either side, and steers towards the one clear for the
+ * longest. How fast it goes depends on how clear the lane it's getting
+ * into is.
+ */
+class steering_bot : public bot
+{
+	bot_settings settings;
+
+	// How many lines the lane the given number of columns aside is clear for.
+	int _lane(race*, int, int);
+
+	public:
+	steering_bot(const bot_settings&);
+	void drive(race*, int);
+};
+
+/*
+ * How far a search bot looks ahead. The room for its ways and for the
+ * road around the car is made up front, by the depth and the beam, so
+ * they can't be any size.
+ */
+#define SEARCH_MAX_DEPTH 64
+#define SEARCH_MAX_BEAM 4096
+
+struct search_settings
+{
+	// The moves of the car, and how many ways it follows at a time.
+	int depth, beam;
+	// The lines of clear road past the end of a way that still count.
+	int range;
+};
+
+/*
+ * Tries out the commands for the car's next moves on copies of the car,
+ * on the track as it is, and gives the first command of the best way it
+ * finds. The search goes a move at a time, the beam of the most promising
+ * ways so far each followed with every command, until the depth. The
+ * nodes are kept from one move to the next, so it allocates nothing.
+ */
+class search_bot : public bot
+{
+	struct node
+	{
+		zr_car car;
+		// Which command the way started with, and how good it looks.
+		int first, score;
+	};
+
+	search_settings settings;
+	vector<node> ways, next;
+	/*
+	 * The road ahead of every place the car can get to, from depth*2
+	 * lines up and depth columns aside, -1 until it's looked at. Many
+	 * ways go through the same places, at other times.
+	 */
+	vector<int> ahead;
+	int ahead_y, ahead_x;
+
+	// How good a car the search got to looks, from how far it got and the road ahead of it.
+	int _score(race*, int, const zr_car&);
+	static bool _better(const node&, const node&);
+
+	public:
+	search_bot(const search_settings&);
+	void drive(race*, int);
+};
+
+extern const search_settings search_default;
+
+// The ready made steering bots, from the most careful one.
+#define BOT_TIERS 3
+
+struct bot_tier
+{
+	const char* name;
+	bot_settings settings;
+};
+
+extern const bot_tier bot_tiers[BOT_TIERS];
+
+/*
+ * Lets the bots drive the cars that move at the next step, a bot per car
+ * of the race, NULL for the ones driven otherwise.
+ */
+void drive_bots(race*, bot* const*);
+
+// A race still going after this many steps per line of it has a bot stuck braking at the top.
+#define STEPS_PER_LINE 20
+
+/*
+ * Races the bot alone on the track of the config and seed, which comes
+ * out the same as the first player's of a bigger race, until it's out or
+ * stuck. Returns how its car did, and the steps taken in the last argument.
+ */
+zr_car solo_heat(const zr_config*, unsigned int, bot*, int*);
+
+#endif
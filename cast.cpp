@@ -0,0 +1,158 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Recording races as asciinema (v2) casts.
+ */
+
+#include "cast.h"
+#include <ctime>
+
+cast_recorder::cast_recorder(const char* path, int lines, int columns)
+{
+	height = lines;
+	width = columns;
+	last_time = 0;
+	quit = false;
+
+	file = fopen(path, "w");
+	if(!file)
+		return;
+	fprintf(file, "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %ld}\n",
+			width, height, (long)time(NULL));
+
+	// The cast starts from a blank screen, like the race does.
+	output = "\033[0m\033[2J\033[H\033[?25l";
+	cursor_y = cursor_x = 0;
+	color = PALETTE_DEFAULT;
+	bold = false;
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&ready, NULL);
+	pthread_create(&writer, NULL, _write, this);
+}
+
+cast_recorder::~cast_recorder(void)
+{
+	if(!file)
+		return;
+
+	// Leave the player's terminal the way it was.
+	output += "\033[0m\033[?25h";
+	frame(last_time);
+
+	pthread_mutex_lock(&lock);
+	quit = true;
+	pthread_cond_signal(&ready);
+	pthread_mutex_unlock(&lock);
+	pthread_join(writer, NULL);
+
+	pthread_cond_destroy(&ready);
+	pthread_mutex_destroy(&lock);
+	fclose(file);
+}
+
+bool cast_recorder::is_open(void)
+{
+	return file != NULL;
+}
+
+void cast_recorder::get_size(int& lines, int& columns)
+{
+	lines = height;
+	columns = width;
+}
+
+void cast_recorder::_move(int y, int x)
+{
+	if(y == cursor_y && x == cursor_x)
+		return;
+
+	char sequence[32];
+	sprintf(sequence, "\033[%d;%dH", y+1, x+1);
+	output += sequence;
+	cursor_y = y;
+	cursor_x = x;
+}
+
+void cast_recorder::put(int y, int x, char character, int new_color, bool new_bold)
+{
+	if(!file || y<0 || height<=y || x<0 || width<=x)
+		return;
+
+	_move(y, x);
+	if(new_color != color || new_bold != bold)
+	{
+		// Colors are on black, like the curses pairs of the game.
+		char sequence[32];
+		if(new_color == PALETTE_DEFAULT)
+			sprintf(sequence, "\033[0%sm", new_bold ? ";1" : "");
+		else
+			sprintf(sequence, "\033[0%s;%d;40m", new_bold ? ";1" : "", 30+new_color);
+		output += sequence;
+		color = new_color;
+		bold = new_bold;
+	}
+	output += character;
+	cursor_x++;
+}
+
+void cast_recorder::frame(double seconds)
+{
+	if(!file || output.empty())
+		return;
+	last_time = seconds;
+
+	pthread_mutex_lock(&lock);
+	pending.push_back(string());
+	pending.back().swap(output);
+	pending_times.push_back(seconds);
+	pthread_cond_signal(&ready);
+	pthread_mutex_unlock(&lock);
+}
+
+void* cast_recorder::_write(void* argument)
+{
+	cast_recorder* self = static_cast<cast_recorder*>(argument);
+	vector<string> frames;
+	vector<double> times;
+
+	pthread_mutex_lock(&self->lock);
+	for(;;)
+	{
+		while(self->pending.empty() && !self->quit)
+			pthread_cond_wait(&self->ready, &self->lock);
+		if(self->pending.empty())
+			break;
+		// Take everything there is, the game can go on meanwhile.
+		frames.swap(self->pending);
+		times.swap(self->pending_times);
+		pthread_mutex_unlock(&self->lock);
+
+		for(unsigned i = 0; i<frames.size(); i++)
+		{
+			fprintf(self->file, "[%.6f, \"o\", \"", times[i]);
+			// The output goes in a JSON string.
+			for(unsigned j = 0; j<frames[i].size(); j++)
+			{
+				unsigned char c = frames[i][j];
+				if(c == '"' || c == '\\')
+					fprintf(self->file, "\\%c", c);
+				else if(c < 0x20 || c == 0x7f)
+					fprintf(self->file, "\\u%04x", c);
+				else
+					fputc(c, self->file);
+			}
+			fputs("\"]\n", self->file);
+		}
+		// Someone may be watching the file grow.
+		fflush(self->file);
+		frames.clear();
+		times.clear();
+
+		pthread_mutex_lock(&self->lock);
+	}
+	pthread_mutex_unlock(&self->lock);
+	return NULL;
+}
@@ -0,0 +1,63 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Recording races as asciinema (v2) casts.
+ *
+ * The recorder is a canvas: whatever is put on it is turned into the
+ * escape sequences a terminal would need to show it, and every frame
+ * becomes one output event of the cast. The file is written on a thread
+ * of its own, so a frame costs only the encoding of the cells it changed.
+ */
+
+#ifndef CAST_H
+#define CAST_H
+
+#include "engine.h"
+#include <pthread.h>
+#include <cstdio>
+#include <string>
+
+class cast_recorder : public canvas
+{
+	int height, width;
+	// Where the terminal's cursor is and what it draws with, as far as
+	// the frame being encoded goes.
+	int cursor_y, cursor_x, color;
+	bool bold;
+	// The output of the frame being encoded, and when the last one was.
+	string output;
+	double last_time;
+
+	FILE* file;
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	// Frames done, but not written yet, and their times.
+	vector<string> pending;
+	vector<double> pending_times;
+	bool quit;
+
+	cast_recorder(const cast_recorder&);
+	cast_recorder& operator=(const cast_recorder&);
+
+	static void* _write(void*);
+	void _move(int, int);
+
+	public:
+	/*
+	 * Creates the cast file for a terminal of the given height and width
+	 * and writes the header. Check is_open() afterwards.
+	 */
+	cast_recorder(const char*, int, int);
+	// Writes out whatever is left and closes the file.
+	~cast_recorder(void);
+	bool is_open(void);
+	void get_size(int&, int&);
+	void put(int, int, char, int, bool);
+	// Ends the frame, shown at the given number of seconds into the cast.
+	void frame(double);
+};
+
+#endif
@@ -0,0 +1,1270 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * The simulation part of ZRacer: track generator, cars and the rules.
+ */
+
+#include "engine.h"
+#include "generator.h"
+#include "pool.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// Make passage, but don't exceed available space.
+#define MINIMAL_WIDTH(config)\
+	(min((config)->players*(config)->car_size*2.5, (double)(config)->race_width-2))
+
+/*
+ * The step kernels for a car size, for one and two players, on shared
+ * tracks and not. Anything else gets the generic ones.
+ */
+#define KERNELS(n)\
+	if(config.car_size == n && config.players == 1)\
+		kernel = config.shared_track ? &race::_step<n, 1, true> : &race::_step<n, 1, false>;\
+	if(config.car_size == n && config.players == 2)\
+		kernel = config.shared_track ? &race::_step<n, 2, true> : &race::_step<n, 2, false>;
+
+// The same for the car's image, only the size matters there.
+#define DRAWER(n)\
+	if(size == n)\
+		drawer = &car_image::_display<n>;
+
+// Used when the caller leaves the geometry to us and there's no screen to ask.
+#define DEFAULT_RACE_WIDTH 80
+#define DEFAULT_VIEW_HEIGHT 24
+
+bool resolve_config(zr_config* config)
+{
+	// Adjust settings, if needed.
+	if(config->race_width == 0)
+		config->race_width = DEFAULT_RACE_WIDTH;
+	if(config->minimal_width == 0)
+		config->minimal_width = (int)(MINIMAL_WIDTH(config));
+	if(config->view_height == 0)
+		config->view_height = min(DEFAULT_VIEW_HEIGHT, config->race_length);
+	if(config->laps == 0)
+		config->laps = 1;
+
+	// And refuse anything the generator or the rules would choke on.
+	return 1 <= config->players &&
+		2 <= config->car_size && config->car_size <= MAX_CAR_SIZE &&
+		1 <= config->speed_base &&
+		3 <= config->race_width &&
+		0 < config->minimal_width && config->minimal_width <= config->race_width &&
+		config->car_size <= config->view_height &&
+		config->view_height <= config->race_length &&
+		0 <= config->rock_chance && config->rock_chance <= 1 &&
+		0 <= config->turn_chance && config->turn_chance <= 1 &&
+		0 <= config->command_policy && config->command_policy <= ZR_FIRST_WINS &&
+		0 <= config->generator && config->generator < ZR_GENERATORS &&
+		// The lines of all the laps have to be ints.
+		1 <= config->laps && config->laps <= INF/config->race_length;
+}
+
+/*
+ * This is splitmix64, small and good enough for a game. The seed is
+ * scrambled once so that consecutive seeds give unrelated races.
+ */
+random_source::random_source(unsigned int seed)
+{
+	state = seed;
+	next();
+}
+
+race::race(const zr_config* settings, unsigned int seed, zr_car* storage)
+{
+	config = *settings;
+	random_source random(seed);
+	car = NULL;
+	crew = NULL;
+
+	// Out of memory, what's been made so far goes, as no destructor will run.
+	try
+	{
+		// Prepare the courses.
+		owned.reserve(config.players);
+		if(config.shared_track || config.similar_track)
+		{
+			owned.push_back(new track(&config, &random));
+			courses.assign(config.players, owned[0]);
+		}
+		else
+			for(int i = 0; i<config.players; i++)
+			{
+				owned.push_back(new track(&config, &random));
+				courses.push_back(owned[i]);
+			}
+
+		car = new car_image(&config);
+
+		if(storage)
+			cars = storage;
+		else
+		{
+			own_cars.resize(config.players);
+			cars = &own_cars[0];
+		}
+		table.resize(config.players);
+		queues.resize(config.players);
+		laps_done.assign(config.players, 0);
+		lap_times.assign(config.players*config.laps, 0);
+	}
+	catch(...)
+	{
+		for(unsigned int i = 0; i<owned.size(); i++)
+			delete owned[i];
+		delete car;
+		throw;
+	}
+	for(int i = 0; i<config.players; i++)
+	{
+		// Place the car at a reasonable place.
+		table.y[i] = config.race_length*config.laps - config.car_size;
+		if(config.shared_track)
+			table.x[i] = (config.race_width - (config.car_size+1)*(config.players-2*i))/ 2;
+		else
+			table.x[i] = config.race_width/2;
+
+		// We want the car at the very bottom of the view.
+		table.top_line[i] = config.race_length*config.laps - config.view_height;
+
+		// If not set, the player actually could freeze for a while.
+		table.last_move[i] = -INF;
+
+		// And make sure player doesn't take off.
+		table.command_y[i] = table.command_x[i] = 0;
+		queues[i].clear();
+
+		table.status[i] = ZR_RACING;
+		table.finish_time[i] = 0;
+		table.moved[i] = 0;
+		_publish(i);
+
+		// Checking for player-player collisions is realized by marking each
+		// player's position as an obstacle on the track.
+		if(config.shared_track)
+			courses[i]->mark(table.y[i], table.x[i], car);
+	}
+	racing = config.players;
+
+	// The default size and a few around it.
+	kernel = config.shared_track ? &race::_step<0, 0, true> : &race::_step<0, 0, false>;
+	KERNELS(4)
+	KERNELS(6)
+	KERNELS(8)
+	KERNELS(10)
+	KERNELS(12)
+
+	// Let the moves begin.
+	time = 0;
+
+	// The movers near the start are there from the beginning.
+	traffic = false;
+	for(unsigned int i = 0; i<owned.size(); i++)
+		traffic = traffic || owned[i]->has_traffic();
+	if(traffic)
+		_traffic();
+}
+
+race::~race(void)
+{
+	for(unsigned int i = 0; i<owned.size(); i++)
+		delete owned[i];
+	delete car;
+	delete crew;
+}
+
+int race::step(void)
+{
+	return (this->*kernel)();
+}
+
+template<int SIZE, int PLAYERS, bool SHARED>
+int race::_step(void)
+{
+	const int players = PLAYERS ? PLAYERS : config.players;
+	const int size = SIZE ? SIZE : config.car_size;
+	const int speed = config.speed_base, height = config.view_height;
+	time++;
+	if(traffic)
+		_traffic();
+
+	/*
+	 * The moving rule, for all the cars at once. It needs nothing but the
+	 * car itself, so the cars can go through it before any of them meets
+	 * the track.
+	 */
+	int* y = &table.y[0];
+	int* x = &table.x[0];
+	int* top_line = &table.top_line[0];
+	int* last_move = &table.last_move[0];
+	int* command_y = &table.command_y[0];
+	int* command_x = &table.command_x[0];
+	const int* status = &table.status[0];
+	int* moved = &table.moved[0];
+	int* from_y = &table.from_y[0];
+	int* from_x = &table.from_x[0];
+	for(int i = 0; i<players; i++)
+	{
+		// The higher the car on the screen, the faster it moves.
+		int due = (status[i] == ZR_RACING) & (last_move[i] + (y[i]-top_line[i])/speed < time);
+		// Watch to not segfault here.
+		int top = max(0, top_line[i]-1);
+		// Commands, all that came since the previous move, but not off the screen.
+		int next = max(top, min(top + height - size, y[i] - 1 + command_y[i]));
+
+		moved[i] = due;
+		from_y[i] = y[i];
+		from_x[i] = x[i];
+		y[i] = due ? next : y[i];
+		x[i] += due ? command_x[i] : 0;
+		top_line[i] = due ? top : top_line[i];
+		last_move[i] = due ? time : last_move[i];
+		command_y[i] = due ? 0 : command_y[i];
+		command_x[i] = due ? 0 : command_x[i];
+	}
+
+	// Then the track, all the cars at once if there are enough to share.
+	if(crew && players > CREW_BLOCK)
+		crew->run(&race::_check_block<SIZE, SHARED>, this, (players + CREW_BLOCK-1)/CREW_BLOCK);
+	else
+		_check<SIZE, SHARED>(0, players);
+
+	/*
+	 * And the cars against each other, one after another as they come.
+	 * Like it always was, a car is marked where it got to whatever became
+	 * of it, so the ones coming after it this step run into its wreck.
+	 */
+	int* outcome = &table.outcome[0];
+	bool gone = false;
+	for(int i = 0; i<players; i++)
+	{
+		if(moved[i])
+		{
+			// What's left of the commands goes to the next move.
+			queues[i].use(config.command_policy);
+			queues[i].fold(config.command_policy, table.command_y[i], table.command_x[i]);
+			if(SHARED)
+			{
+				// A car mustn't collide with itself.
+				courses[i]->unmark<SIZE>(from_y[i], from_x[i], car);
+				if(outcome[i] == ZR_RACING && courses[i]->touches<SIZE>(LETHAL_LAYERS, y[i], x[i], car))
+					outcome[i] = ZR_CRASHED;
+				courses[i]->mark<SIZE>(y[i], x[i], car);
+			}
+			// A crash ends the race where it was, whatever line the car got to.
+			if(outcome[i] != ZR_CRASHED)
+				_lap(i);
+			if(outcome[i] == ZR_RACING)
+				last_move[i] += table.delay[i];
+			else
+			{
+				table.status[i] = outcome[i];
+				table.finish_time[i] = time;
+				racing--;
+				gone = true;
+			}
+			_publish(i);
+		}
+		else
+			cars[i].moved = 0;
+	}
+
+	/*
+	 * The cars out of the race are taken off the track after the step.
+	 * A wreck may share cells with a car it ran into, that one is marked
+	 * again.
+	 */
+	if(SHARED && gone)
+	{
+		for(int i = 0; i<players; i++)
+			if(moved[i] && table.status[i] != ZR_RACING)
+				courses[i]->unmark<SIZE>(y[i], x[i], car);
+		for(int i = 0; i<players; i++)
+			if(table.status[i] == ZR_RACING)
+				courses[i]->mark<SIZE>(y[i], x[i], car);
+	}
+
+	return racing;
+}
+
+template<int SIZE, bool SHARED>
+void race::_check(int first, int last)
+{
+	for(int i = first; i<last; i++)
+		if(table.moved[i])
+			table.outcome[i] = _move<SIZE, SHARED>(i);
+}
+
+template<int SIZE, bool SHARED>
+void race::_check_block(void* argument, int block, int)
+{
+	race* self = static_cast<race*>(argument);
+	self->_check<SIZE, SHARED>(block*CREW_BLOCK, min((block+1)*CREW_BLOCK, self->config.players));
+}
+
+void race::_traffic(void)
+{
+	for(unsigned int i = 0; i<owned.size(); i++)
+	{
+		// What the views of the cars still racing on the track span.
+		int top = INF, bottom = -INF;
+		for(int j = 0; j<config.players; j++)
+			if(courses[j] == owned[i] && table.status[j] == ZR_RACING)
+			{
+				top = min(top, table.top_line[j]);
+				bottom = max(bottom, table.top_line[j] + config.view_height);
+			}
+		if(top < bottom)
+			owned[i]->traffic(time, top, bottom);
+	}
+}
+
+template<int SIZE, bool SHARED>
+int race::_move(int index)
+{
+	int y = table.y[index], x = table.x[index];
+	track* course = courses[index];
+
+	if(y <= 0) // Plain win
+		return ZR_FINISHED;
+
+	// Check for collisions, on a shared track they come later.
+	if(!SHARED && course->touches<SIZE>(LETHAL_LAYERS, y, x, car))
+		return ZR_CRASHED;
+
+	// What the car drives over decides when it moves next.
+	int& delay = table.delay[index];
+	delay = 0;
+	if(course->has_surfaces())
+	{
+		if(course->touches<SIZE>(1<<ZR_LAYER_BOOST, y, x, car))
+			delay -= BOOST_TURNS;
+		if(course->touches<SIZE>(1<<ZR_LAYER_SLOW, y, x, car))
+			delay += SLOW_TURNS;
+	}
+
+	return ZR_RACING;
+}
+
+void race::_lap(int index)
+{
+	// A lap is done on getting to the line the track starts over from.
+	int done = config.laps - (table.y[index] + config.race_length-1)/config.race_length;
+	while(laps_done[index] < done)
+		lap_times[index*config.laps + laps_done[index]++] = time;
+}
+
+void race::_publish(int index)
+{
+	zr_car& c = cars[index];
+	c.y = table.y[index];
+	c.x = table.x[index];
+	c.top_line = table.top_line[index];
+	c.last_move = table.last_move[index];
+	c.command_y = table.command_y[index];
+	c.command_x = table.command_x[index];
+	c.status = table.status[index];
+	c.finish_time = table.finish_time[index];
+	c.moved = table.moved[index];
+}
+
+void car_table::resize(int size)
+{
+	y.resize(size);
+	x.resize(size);
+	top_line.resize(size);
+	last_move.resize(size);
+	command_y.resize(size);
+	command_x.resize(size);
+	status.resize(size);
+	finish_time.resize(size);
+	moved.resize(size);
+	from_y.resize(size);
+	from_x.resize(size);
+	outcome.resize(size);
+	delay.resize(size);
+}
+
+void race::command(int index, int y, int x, long long when)
+{
+	if(!y && !x)
+		return;
+	// The car shows what its next move is going to be.
+	queues[index].push(when, y, x);
+	queues[index].fold(config.command_policy, table.command_y[index], table.command_x[index]);
+	cars[index].command_y = table.command_y[index];
+	cars[index].command_x = table.command_x[index];
+}
+
+void command_queue::clear(void)
+{
+	first = count = 0;
+}
+
+// A line or a column either way, or none.
+static int unit(int steps)
+{
+	return (steps > 0) - (steps < 0);
+}
+
+void command_queue::push(long long when, int y, int x)
+{
+	if(count == COMMAND_QUEUE)
+	{
+		first = (first+1)%COMMAND_QUEUE;
+		count--;
+	}
+	entry& e = entries[(first+count++)%COMMAND_QUEUE];
+	e.time = when;
+	e.y = unit(y);
+	e.x = unit(x);
+}
+
+void command_queue::fold(int policy, int& y, int& x)
+{
+	y = x = 0;
+	for(int i = 0; i<count; i++)
+	{
+		const entry& e = entries[(first+i)%COMMAND_QUEUE];
+		switch(policy)
+		{
+			case ZR_ACCUMULATE:
+				y += e.y;
+				x += e.x;
+				break;
+			case ZR_FIRST_WINS:
+				if(!y)
+					y = e.y;
+				if(!x)
+					x = e.x;
+				break;
+			default: // ZR_LAST_WINS, as the keys always worked.
+				if(e.y)
+					y = e.y;
+				if(e.x)
+					x = e.x;
+		}
+	}
+	y = unit(y);
+	x = unit(x);
+}
+
+void command_queue::use(int policy)
+{
+	// Only accumulated commands outlast a move, the part of them it didn't go.
+	int y = 0, x = 0;
+	long long when = 0;
+	for(int i = 0; policy == ZR_ACCUMULATE && i<count; i++)
+	{
+		const entry& e = entries[(first+i)%COMMAND_QUEUE];
+		y += e.y;
+		x += e.x;
+		when = e.time;
+	}
+	y -= unit(y);
+	x -= unit(x);
+	clear();
+	// Kept as a command of their own, no more than a full queue of them.
+	if(y || x)
+	{
+		entry& e = entries[count++];
+		e.time = when;
+		e.y = max(-COMMAND_QUEUE, min(COMMAND_QUEUE, y));
+		e.x = max(-COMMAND_QUEUE, min(COMMAND_QUEUE, x));
+	}
+}
+
+void race::sense(int index, int range, int* distances)
+{
+	const zr_car& c = cars[index];
+	const int size = config.car_size;
+	track* course = courses[index];
+
+	// From just off the car's square, so it doesn't see itself on a shared track.
+	distances[ZR_RAY_LEFT] = course->ray(c.y + size/2, c.x-1, 0, -1, range);
+	distances[ZR_RAY_FORWARD_LEFT] = course->ray(c.y-1, c.x-1, -1, -1, range);
+	distances[ZR_RAY_FORWARD] = course->ray(c.y-1, c.x + size/2, -1, 0, range);
+	distances[ZR_RAY_FORWARD_RIGHT] = course->ray(c.y-1, c.x+size, -1, 1, range);
+	distances[ZR_RAY_RIGHT] = course->ray(c.y + size/2, c.x+size, 0, 1, range);
+}
+
+bool race::due(int index)
+{
+	// The same rule as in the steps.
+	return table.status[index] == ZR_RACING &&
+		table.last_move[index] + (table.y[index]-table.top_line[index])/config.speed_base < time+1;
+}
+
+int race::advance(int index, zr_car& c)
+{
+	const int size = config.car_size;
+	track* course = courses[index];
+
+	// The same rule as in the steps, at the step the move is due.
+	int when = max(time+1, c.last_move + (c.y-c.top_line)/config.speed_base + 1);
+	int top = max(0, c.top_line-1);
+	c.y = max(top, min(top + config.view_height - size, c.y - 1 + c.command_y));
+	c.x += c.command_x;
+	c.top_line = top;
+	c.last_move = when;
+	c.command_y = c.command_x = 0;
+	c.moved = 1;
+
+	// On a shared track the car is still marked where it is, it mustn't run into that.
+	car_place place;
+	c.status = ZR_RACING;
+	if(c.y <= 0)
+		c.status = ZR_FINISHED;
+	else if(course->touches<0>(LETHAL_LAYERS, c.y, c.x, car, _own(index, place)))
+		c.status = ZR_CRASHED;
+	else if(course->has_surfaces())
+	{
+		if(course->touches<0>(1<<ZR_LAYER_BOOST, c.y, c.x, car))
+			c.last_move -= BOOST_TURNS;
+		if(course->touches<0>(1<<ZR_LAYER_SLOW, c.y, c.x, car))
+			c.last_move += SLOW_TURNS;
+	}
+	if(c.status != ZR_RACING)
+		c.finish_time = when;
+	return c.status;
+}
+
+int race::clearance(int index, int y, int left, int right, int range)
+{
+	car_place place;
+	return courses[index]->clearance(y, left, right, range, _own(index, place));
+}
+
+const car_place* race::_own(int index, car_place& place)
+{
+	if(!config.shared_track || table.status[index] != ZR_RACING)
+		return NULL;
+	place.y = table.y[index];
+	place.x = table.x[index];
+	place.car = car;
+	return &place;
+}
+
+void race::retire(int index)
+{
+	if(table.status[index] != ZR_RACING)
+		return;
+	if(config.shared_track)
+		courses[index]->unmark(table.y[index], table.x[index], car);
+	table.status[index] = ZR_RETIRED;
+	table.finish_time[index] = time;
+	_publish(index);
+	racing--;
+}
+
+void race::set_threads(int threads)
+{
+	// Left on one thread if the new ones can't be had.
+	delete crew;
+	crew = NULL;
+	crew = threads > 1 ? new work_pool(threads) : NULL;
+}
+
+int race::get_time(void)
+{
+	return time;
+}
+
+int race::get_cars(void)
+{
+	return config.players;
+}
+
+const zr_car& race::get_car(int index)
+{
+	return cars[index];
+}
+
+const zr_car* race::get_car_data(void)
+{
+	return cars;
+}
+
+int race::get_laps(int index)
+{
+	return laps_done[index];
+}
+
+const int* race::get_lap_times(int index)
+{
+	return &lap_times[index*config.laps];
+}
+
+track* race::get_course(int index)
+{
+	return courses[index];
+}
+
+car_image* race::get_car_image(void)
+{
+	return car;
+}
+
+const zr_config& race::get_config(void)
+{
+	return config;
+}
+
+track::track(const zr_config* config, random_source* random)
+{
+	length = config->race_length;
+	width = config->race_width;
+	character = config->character;
+
+	// Allocate the structures, with some background already.
+	circuit.assign(length*width, ' ');
+
+	// And create the course!
+	assert(config->minimal_width <= width);
+	generators[config->generator].generate(&circuit[0], &movers, config, random);
+	_classify();
+	loop = config->laps > 1;
+	waiting = 0;
+	lap_line = (config->laps-1)*length;
+}
+
+void track::_classify(void)
+{
+	words = (width+63)/64;
+	planes.assign(ZR_LAYERS*length*words, 0);
+	surfaces = false;
+
+	for(int i = 0; i<length; i++)
+		for(int j = 0; j<width; j++)
+			switch(circuit[i*width+j])
+			{
+				case ' ':
+					break;
+				case '*':
+					_set(ZR_LAYER_ROCK, i, j);
+					break;
+				case '+':
+					_set(ZR_LAYER_BOOST, i, j);
+					surfaces = true;
+					break;
+				case '~':
+					_set(ZR_LAYER_SLOW, i, j);
+					surfaces = true;
+					break;
+				default: // The kerbs and the distance meter.
+					_set(ZR_LAYER_KERB, i, j);
+			}
+
+	// The finish is whatever can be driven onto in the top line.
+	for(int j = 0; j<width; j++)
+		if(!_on(LETHAL_LAYERS, 0, j))
+			_set(ZR_LAYER_FINISH, 0, j);
+
+	obstacles.resize(length*words);
+	for(int i = 0; i<length; i++)
+		for(int j = 0; j<words; j++)
+			_refresh(i, j);
+
+	// The road of a chunk is where all its rows have it.
+	row_chunk open = {0, width-1, 0, 0};
+	chunks.assign((length+CHUNK_ROWS-1)/CHUNK_ROWS, open);
+	for(int i = 0; i<length; i++)
+	{
+		row_chunk& k = chunks[i/CHUNK_ROWS];
+		// Between the first kerb after the meter and the last one, a word at a time.
+		const unsigned long long* kerbs = get_plane(ZR_LAYER_KERB, i);
+		int first = width, last = 0;
+		for(int j = 0; j<words; j++)
+		{
+			unsigned long long found = kerbs[j] & (j ? ~0ULL : ~1ULL);
+			if(!found)
+				continue;
+			first = min(first, j*64 + __builtin_ctzll(found));
+			last = j*64 + 63 - __builtin_clzll(found);
+		}
+		k.left = max(k.left, first+1);
+		k.right = min(k.right, last-1);
+	}
+	for(int i = 0; i<length; i++)
+	{
+		row_chunk& k = chunks[i/CHUNK_ROWS];
+		const unsigned long long* rocks = get_plane(ZR_LAYER_ROCK, i);
+		int left = max(k.left, 0);
+		for(int j = left/64; left<=k.right && j<=k.right/64; j++)
+		{
+			unsigned long long road = ~0ULL;
+			if(j == left/64)
+				road &= ~0ULL << left%64;
+			if(j == k.right/64)
+				road &= ~0ULL >> (63 - k.right%64);
+			k.rocks += __builtin_popcountll(rocks[j] & road);
+		}
+	}
+}
+
+void track::display(canvas* screen, int top_line, int left_column)
+{
+	// Get the geometry.
+	int screen_width, screen_height;
+	screen->get_size(screen_height, screen_width);
+
+	// The visible columns, the rest of the row costs nothing.
+	int first = max(left_column, 0);
+	int last = min(left_column+screen_width, width);
+
+	// For every visible line, a circuit goes on for ever...
+	int end = loop ? top_line+screen_height : min(top_line+screen_height, length);
+	for(int i = max(top_line, 0); i<end; i++)
+	{
+		const char* row = &circuit[_wrap(i)*width];
+		const unsigned long long* cars = get_plane(ZR_LAYER_CAR, _wrap(i));
+		const unsigned long long* boost = get_plane(ZR_LAYER_BOOST, _wrap(i));
+		const unsigned long long* slow = get_plane(ZR_LAYER_SLOW, _wrap(i));
+		const unsigned long long* moving = get_plane(ZR_LAYER_MOVER, _wrap(i));
+		// And print all the characters, the way their layers look.
+		for(int j = first; j<last; j++)
+		{
+			unsigned long long bit = 1ULL << j%64;
+			if(cars[j/64] & bit)
+				screen->put(i-top_line, j-left_column, character, PALETTE_DEFAULT, false);
+			else if(moving[j/64] & bit)
+				screen->put(i-top_line, j-left_column, '@', PALETTE_RED, true);
+			else
+				screen->put(i-top_line, j-left_column, row[j],
+						boost[j/64] & bit ? PALETTE_GREEN :
+						slow[j/64] & bit ? PALETTE_BLUE : PALETTE_DEFAULT, false);
+		}
+	}
+}
+
+void track::window(int top_line, int left_column, int rows, int columns, char* cells)
+{
+	memset(cells, ' ', rows*columns);
+	int first = max(left_column, 0);
+	int last = min(left_column+columns, width);
+	int end = loop ? top_line+rows : min(top_line+rows, length);
+	for(int i = max(top_line, 0); i<end; i++)
+	{
+		const char* row = &circuit[_wrap(i)*width];
+		const unsigned long long* cars = get_plane(ZR_LAYER_CAR, _wrap(i));
+		const unsigned long long* moving = get_plane(ZR_LAYER_MOVER, _wrap(i));
+		char* cell = cells + (i-top_line)*columns - left_column;
+		for(int j = first; j<last; j++)
+		{
+			unsigned long long bit = 1ULL << j%64;
+			cell[j] = cars[j/64] & bit ? character : moving[j/64] & bit ? '@' : row[j];
+		}
+	}
+}
+
+bool track::taken(int y, int x)
+{
+	if(x<0 || width<=x || (!loop && (y<0 || length<=y)))
+		return true;
+	return obstacles[_wrap(y)*words + x/64] >> x%64 & 1;
+}
+
+template<int SIZE>
+bool track::touches(unsigned int layers, int y, int x, car_image* car, const car_place* own)
+{
+	const int size = SIZE ? SIZE : car->get_size();
+
+	// Partly off the track, that's rare enough to go pace by pace.
+	if(!_inside(y, x, size))
+	{
+		for(int i = 0; i<size; i++)
+			for(unsigned int m = car->get_mask(i); m; m &= m-1)
+			{
+				int row = y+i, column = x+__builtin_ctz(m);
+				if(column<0 || width<=column || (!loop && (row<0 || length<=row)))
+					return true;
+				unsigned int asked = layers;
+				if(_mine(_wrap(row), column/64, own) >> column%64 & 1)
+					asked &= ~(1U<<ZR_LAYER_CAR);
+				if(_on(asked, _wrap(row), column))
+					return true;
+			}
+		return false;
+	}
+
+	// Otherwise every row of the car is a word or two of every layer.
+	for(int i = 0, row = _wrap(y); i<size; i++, row = row+1 < length ? row+1 : 0)
+	{
+		unsigned long long low, high;
+		_shift(car->get_mask(i), x, low, high);
+		if(layers == LETHAL_LAYERS)
+		{
+			// The usual question has its own plane.
+			if(!own)
+			{
+				const unsigned long long* word = &obstacles[row*words + x/64];
+				if(word[0] & low || (high && word[1] & high))
+					return true;
+			}
+			else if(_lethal(row, x/64, own) & low || (high && _lethal(row, x/64+1, own) & high))
+				return true;
+			continue;
+		}
+		const unsigned long long* word = &planes[row*words + x/64];
+		for(int l = 0; l<ZR_LAYERS; l++)
+			if(layers & 1U<<l)
+			{
+				const unsigned long long* plane = word + l*length*words;
+				unsigned long long mine_low = 0, mine_high = 0;
+				if(l == ZR_LAYER_CAR)
+				{
+					mine_low = _mine(row, x/64, own);
+					mine_high = high ? _mine(row, x/64+1, own) : 0;
+				}
+				if(plane[0] & low & ~mine_low || (high && plane[1] & high & ~mine_high))
+					return true;
+			}
+	}
+	return false;
+}
+
+void track::_place(mover& m, int time)
+{
+	int along = time/m.period + m.phase;
+	if(m.bounce)
+	{
+		// There and back again, the room it has being the way there.
+		int room = m.span - m.size;
+		int k = room ? along%(2*room) : 0;
+		m.x = m.left + (k <= room ? k : 2*room-k);
+	}
+	else
+	{
+		// From fully off one side to fully off the other.
+		int k = along%(m.span + m.size);
+		m.x = m.direction > 0 ? m.left - m.size + k : m.left + m.span - k;
+	}
+}
+
+void track::_paint(const mover& m, int x, bool on)
+{
+	unsigned long long* plane = &planes[(ZR_LAYER_MOVER*length + m.y)*words];
+	for(int j = max(x, m.left); j<min(x+m.size, m.left+m.span); j++)
+		if(on)
+			plane[j/64] |= 1ULL << j%64;
+		else
+			plane[j/64] &= ~(1ULL << j%64);
+	// One to a row, so all of it came or left.
+	_moving(m.y, (on ? 1 : -1)*max(0, min(x+m.size, m.left+m.span) - max(x, m.left)));
+	for(int j = m.left/64; j<=(m.left+m.span-1)/64; j++)
+		_refresh(m.y, j);
+}
+
+int track::ray(int y, int x, int dy, int dx, int range)
+{
+	if(range<=0 || x<0 || width<=x || (!loop && (y<0 || length<=y)))
+		return 0;
+	int row = _wrap(y), column = x;
+
+	if(dy || !dx)
+	{
+		// Line by line, a cell of each, until it would leave the track.
+		int cells = range;
+		if(dx)
+			cells = min(cells, dx < 0 ? x+1 : width-x);
+		if(dy && !loop)
+			cells = min(cells, dy < 0 ? y+1 : length-y);
+		for(int free = 0; free<cells; )
+		{
+			// The rest of a chunk with nothing where the ray crosses it is passed at once.
+			int first = row/CHUNK_ROWS*CHUNK_ROWS;
+			int lines = dy < 0 ? row-first+1 : min(first+CHUNK_ROWS, length)-row;
+			int last = column + dx*(lines-1);
+			if(!dy || !_clear(row/CHUNK_ROWS, min(column, last), max(column, last)))
+			{
+				if(obstacles[row*words + (unsigned)column/64] >> (unsigned)column%64 & 1)
+					return free;
+				lines = 1;
+			}
+			free += lines;
+			column += dx*lines;
+			row += dy*lines;
+			if(row < 0)
+				row += length;
+			else if(row >= length)
+				row -= length;
+		}
+		return cells;
+	}
+
+	if(dx < 0)
+	{
+		// The highest obstacle at the column or left of it, a word at a time.
+		while(0 <= column && x-column < range)
+		{
+			int word = column/64;
+			unsigned long long found = obstacles[row*words + word] & ~0ULL >> (63 - column%64);
+			if(found)
+				return min(range, x - (word*64 + 63 - __builtin_clzll(found)));
+			column = word*64 - 1;
+		}
+		return min(range, x-column);
+	}
+	// And the lowest one right of it. Past the width there's nothing in the words.
+	while(column < width && column-x < range)
+	{
+		int word = column/64;
+		unsigned long long found = obstacles[row*words + word] & ~0ULL << column%64;
+		if(found)
+			return min(range, word*64 + __builtin_ctzll(found) - x);
+		column = word*64 + 64;
+	}
+	return min(range, min(column, width) - x);
+}
+
+int track::clearance(int y, int left, int right, int range, const car_place* own)
+{
+	if(range<=0 || left<0 || width<=right || right<left || (!loop && (y<0 || length<=y)))
+		return 0;
+	if(!loop)
+		range = min(range, y+1);
+
+	int row = _wrap(y), free = 0;
+	while(free < range)
+	{
+		int first = row/CHUNK_ROWS*CHUNK_ROWS;
+		if(_clear(row/CHUNK_ROWS, left, right))
+		{
+			// Up to the top of the chunk, nothing there.
+			free += row-first+1;
+			row = first-1;
+		}
+		else
+		{
+			// The row word by word, the first and the last one cut down to the columns.
+			for(int word = left/64; word<=right/64; word++)
+			{
+				unsigned long long mask = ~0ULL;
+				if(word == left/64)
+					mask &= ~0ULL << left%64;
+				if(word == right/64)
+					mask &= ~0ULL >> (63 - right%64);
+				if(_lethal(row, word, own) & mask)
+					return free;
+			}
+			free++;
+			row--;
+		}
+		if(row < 0)
+			row += length;
+	}
+	return min(free, range);
+}
+
+bool track::_seen(const mover& m, int top, int bottom)
+{
+	// The first line from the top on the row, there's one every lap on a circuit.
+	int line = loop ? top + _wrap(m.y - top) : m.y;
+	return top <= line && line < bottom;
+}
+
+void track::traffic(int time, int top, int bottom)
+{
+	// The views have left these behind, for this lap at least.
+	for(unsigned int i = 0; i<active.size(); )
+	{
+		mover& m = movers[active[i]];
+		if(!_seen(m, top, bottom))
+		{
+			_paint(m, m.x, false);
+			m.shown = false;
+			active[i] = active.back();
+			active.pop_back();
+		}
+		else
+			i++;
+	}
+
+	/*
+	 * These they've just reached, going round again on a circuit. Skipped
+	 * over ones are seen next lap, if ever.
+	 */
+	while(waiting<movers.size() && lap_line + movers[waiting].y >= top)
+	{
+		mover& m = movers[waiting];
+		if(!m.shown && _seen(m, top, bottom))
+		{
+			_place(m, time);
+			_paint(m, m.x, true);
+			m.shown = true;
+			active.push_back(waiting);
+		}
+		if(++waiting == movers.size() && lap_line > 0)
+		{
+			waiting = 0;
+			lap_line -= length;
+		}
+	}
+
+	// And the rest goes on, only one to a row, so they can't rub each other out.
+	for(unsigned int i = 0; i<active.size(); i++)
+	{
+		mover& m = movers[active[i]];
+		int was = m.x;
+		_place(m, time);
+		if(m.x != was)
+		{
+			_paint(m, was, false);
+			_paint(m, m.x, true);
+		}
+	}
+}
+
+bool track::has_traffic(void)
+{
+	return !movers.empty();
+}
+
+void track::mark(int y, int x, car_image *car)
+{
+	mark<0>(y, x, car);
+}
+
+void track::unmark(int y, int x, car_image *car)
+{
+	unmark<0>(y, x, car);
+}
+
+template<int SIZE>
+void track::mark(int y, int x, car_image* car)
+{
+	const int size = SIZE ? SIZE : car->get_size();
+
+	if(!_inside(y, x, size))
+	{
+		// Only the paces on the track, and not on a kerb or a rock, like below.
+		for(int i = 0; i<size; i++)
+			for(unsigned int m = car->get_mask(i); m; m &= m-1)
+			{
+				int row = y+i, column = x+__builtin_ctz(m);
+				if((loop || (0<=row && row<length)) && 0<=column && column<width)
+				{
+					row = _wrap(row);
+					const unsigned long long bit = 1ULL << column%64;
+					const int word = row*words + column/64;
+					unsigned long long& cars = planes[ZR_LAYER_CAR*length*words + word];
+					if((planes[ZR_LAYER_KERB*length*words + word] | planes[ZR_LAYER_ROCK*length*words + word]) & bit)
+						continue;
+					_moving(row, !(cars & bit));
+					cars |= bit;
+					_refresh(row, column/64);
+				}
+			}
+		return;
+	}
+
+	// A known number of rows, each a word or two, leaving out the scenery.
+	for(int i = 0, row = _wrap(y); i<size; i++, row = row+1 < length ? row+1 : 0)
+	{
+		unsigned long long low, high;
+		_shift(car->get_mask(i), x, low, high);
+		const unsigned long long* kerbs = &planes[(ZR_LAYER_KERB*length + row)*words + x/64];
+		const unsigned long long* rocks = &planes[(ZR_LAYER_ROCK*length + row)*words + x/64];
+		unsigned long long* cars = &planes[(ZR_LAYER_CAR*length + row)*words + x/64];
+		unsigned long long* lethal = &obstacles[row*words + x/64];
+		low &= ~(kerbs[0] | rocks[0]);
+		_moving(row, __builtin_popcountll(low & ~cars[0]));
+		cars[0] |= low;
+		lethal[0] |= low;
+		if(high)
+		{
+			high &= ~(kerbs[1] | rocks[1]);
+			_moving(row, __builtin_popcountll(high & ~cars[1]));
+			cars[1] |= high;
+			lethal[1] |= high;
+		}
+	}
+}
+
+template<int SIZE>
+void track::unmark(int y, int x, car_image* car)
+{
+	const int size = SIZE ? SIZE : car->get_size();
+
+	if(!_inside(y, x, size))
+	{
+		for(int i = 0; i<size; i++)
+			for(unsigned int m = car->get_mask(i); m; m &= m-1)
+			{
+				int row = y+i, column = x+__builtin_ctz(m);
+				if((loop || (0<=row && row<length)) && 0<=column && column<width)
+				{
+					unsigned long long& word = planes[(ZR_LAYER_CAR*length + _wrap(row))*words + column/64];
+					_moving(_wrap(row), -(int)(word >> column%64 & 1));
+					word &= ~(1ULL << column%64);
+					_refresh(_wrap(row), column/64);
+				}
+			}
+		return;
+	}
+
+	for(int i = 0, row = _wrap(y); i<size; i++, row = row+1 < length ? row+1 : 0)
+	{
+		unsigned long long low, high;
+		_shift(car->get_mask(i), x, low, high);
+		unsigned long long* cars = &planes[(ZR_LAYER_CAR*length + row)*words + x/64];
+		_moving(row, -__builtin_popcountll(cars[0] & low));
+		cars[0] &= ~low;
+		_refresh(row, x/64);
+		if(high)
+		{
+			_moving(row, -__builtin_popcountll(cars[1] & high));
+			cars[1] &= ~high;
+			_refresh(row, x/64+1);
+		}
+	}
+}
+
+int track::get_length(void)
+{
+	return length;
+}
+
+int track::get_width(void)
+{
+	return width;
+}
+
+const char* track::get_row(int y)
+{
+	return &circuit[y*width];
+}
+
+const unsigned long long* track::get_plane(int layer, int y)
+{
+	return &planes[(layer*length + y)*words];
+}
+
+int track::get_words(void)
+{
+	return words;
+}
+
+bool track::has_surfaces(void)
+{
+	return surfaces;
+}
+
+car_image::car_image(const zr_config* config)
+{
+	character = config->character;
+	color = PALETTE_YELLOW;
+	size = config->car_size;
+
+	// The coolest part - drawing the damned thing
+	_clear();
+	// Original key points were (0,0), (1,4), (2,0), (3,4) and (4,0).
+	// Now we just need to scale them and draw lines between.
+	_line(0, 0, 1*(size-1)/4, 4*(size-1)/4);
+	_line(1*(size-1)/4, 4*(size-1)/4, 2*(size-1)/4, 0);
+	_line(2*(size-1)/4, 0, 3*(size-1)/4, 4*(size-1)/4);
+	_line(3*(size-1)/4, 4*(size-1)/4, 4*(size-1)/4, 0);
+
+	drawer = &car_image::_display<0>;
+	DRAWER(4)
+	DRAWER(6)
+	DRAWER(8)
+	DRAWER(10)
+	DRAWER(12)
+}
+
+void car_image::_clear(void)
+{
+	// Simply clear the image
+	for(int i=0; i<size; i++)
+	{
+		for(int j=0; j<size; j++)
+			storage[i][j]=false;
+		masks[i] = 0;
+	}
+}
+
+void car_image::display(canvas* screen, int y, int x)
+{
+	(this->*drawer)(screen, y, x);
+}
+
+template<int SIZE>
+void car_image::_display(canvas* screen, int y, int x)
+{
+	const int size = SIZE ? SIZE : this->size;
+
+	for(int i=0; i<size; i++)
+	{
+		for(int j=0; j<size; j++)
+			if(storage[i][j])
+				screen->put(y+i, x+j, character, color, true);
+
+	}
+}
+
+void car_image::explode(canvas* screen, int y, int x, random_source* random)
+{// Even in ASCII we can do cool explosions :>
+	for(int i=0; i<size; i++)
+	{
+		for(int j=0; j<size; j++)
+			if(random->below(2))
+				screen->put(y+i, x+j, '*', random->below(7) + 1, false);
+
+	}
+
+}
+
+void car_image::set_character(char new_character)
+{
+	character = new_character;
+}
+
+void car_image::set_color(int new_color)
+{
+	color = new_color;
+}
+
+const vector<pair<int, int> >& car_image::get_dots(void)
+{
+	return dots;
+}
+
+int car_image::get_size(void)
+{
+	return size;
+}
+
+/*
+ * This function is the heart of the original task for which this program
+ * was created. It is based on the simple formula, that for a line between
+ * (y1, x1) and (y2, x2) and a given coordinate x, the y coordinate for a
+ * point on a line is y1 + (y2-y1) / ( (x2-x1)/(x-x1) ).
+ */
+void car_image::_line(int y1, int x1, int y2, int x2)
+{
+	// It can be given the other way round...
+	if(x2 < x1)
+	{
+		// So just swap the points.
+		int tmp = x1;
+		x1 = x2;
+		x2 = tmp;
+		// And swap the other coordinate.
+		tmp = y1;
+		y1 = y2;
+		y2 = tmp;
+	}
+	for(int i=x1; i<=x2; i++)
+	{
+		int y = y1 + (int)((float) (y2-y1)*(i-x1)/(x2-x1)+0.5);
+		// +0.5 is in order to do real rounding, not just truncation.
+		storage[y][i]=true;
+		masks[y] |= 1U << i;
+		dots.push_back(make_pair(y, i));
+	}
+}
@@ -0,0 +1,610 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * The simulation part of ZRacer, shared by the game and libzracer.
+ *
+ * Nothing in here knows about ncurses. Whatever gets drawn, gets drawn on
+ * a canvas, which the game implements with curses windows. All the
+ * settings come from a zr_config passed at construction time, so any
+ * number of tracks and races can live side by side.
+ *
+ * Conventions taken:
+ * 	- coordinates order is (y, x)
+ * 	- (0, 0) is upper left corner of everything
+ * 	- as a result, finish line is at line 0
+ * 	- car doesn't take up the whole rectangle (for collision checking)
+ * 	- the track is stored as its ascii-art representation, and as one
+ * 	  bitplane per layer (ZR_LAYER_*) saying what the cells are
+ * 	- on a shared track the racing cars stay marked on it between steps
+ * 	- a race of several laps goes round a circuit, its lines counting on
+ * 	  from the track's length, line y being row y % length
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "zracer.h"
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+// Various constants
+#define MAX_CAR_SIZE 20
+#define INF 123456789
+#define COMMAND_QUEUE 32
+// The rows of the track summed up together, see row_chunk.
+#define CHUNK_ROWS 64
+// The cars a thread takes at once in a step, see race::_check.
+#define CREW_BLOCK 64
+// How many turns earlier a boost pad lets a car move next, and a slow zone later.
+#define BOOST_TURNS 1
+#define SLOW_TURNS 2
+
+// The layers of whatever a car hits.
+#define LETHAL_LAYERS (1<<ZR_LAYER_KERB | 1<<ZR_LAYER_ROCK | 1<<ZR_LAYER_CAR | 1<<ZR_LAYER_MOVER)
+
+// Action values
+#define ACCELERATE -1
+#define BRAKE 1
+#define LEFT -1
+#define RIGHT 1
+
+// Palette indices, they are the same as curses COLOR_* values.
+#define PALETTE_DEFAULT 0
+#define PALETTE_RED 1
+#define PALETTE_GREEN 2
+#define PALETTE_YELLOW 3
+#define PALETTE_BLUE 4
+#define PALETTE_COLORS 8
+
+/*
+ * Fills in the zeros in the config, the way the game always did, and tells
+ * whether the result is something a race can be run on.
+ */
+bool resolve_config(zr_config*);
+
+/*
+ * The random number generator. Every track and race has its own, so the
+ * same seed always gives the same race, whatever else runs in the process.
+ */
+class random_source
+{
+	unsigned long long state;
+
+	public:
+	random_source(unsigned int);
+	// Inline, the generators call these for every row.
+	unsigned int next(void)
+	{
+		unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return (unsigned int)((z ^ (z >> 31)) >> 32);
+	}
+	// Results in range 0..1, like the old drand().
+	double uniform(void)
+	{
+		return (double)next()/0xFFFFFFFFU;
+	}
+	// Results in range 0..n-1.
+	int below(int n)
+	{
+		return next()%n;
+	}
+};
+
+/*
+ * Whatever the game draws on. Only has to know its size and how to put
+ * a single character with a color (palette index) and boldness.
+ */
+class canvas
+{
+	public:
+	virtual ~canvas(void) {}
+	virtual void get_size(int&, int&) = 0;
+	virtual void put(int, int, char, int, bool) = 0;
+};
+
+class car_image
+{
+	/*
+	 * This is where we store the image of the car.
+	 * For performance purposes, it is created only once when scaled.
+	 */
+	bool storage [MAX_CAR_SIZE+1][MAX_CAR_SIZE+1];
+	// And as list of used pixels coords.
+	vector<pair<int, int> > dots;
+	// And as a bit mask of the used columns of every row, for the kernels.
+	unsigned int masks[MAX_CAR_SIZE+1];
+	char character;
+	int color, size;
+
+	/*
+	 * Internal functions. First one is _clear() - it just sets all
+	 * the storage area to false. Second one is line() - takes coords
+	 * of 2 points and draws a line between them (or more literally
+	 * just marks certain values within storage as true).
+	 */
+	void _clear(void);
+	void _line(int, int, int, int);
+	/*
+	 * The drawing, with the size known at compile time for the common
+	 * sizes (0 means the size of the image). The constructor picks the
+	 * one display() uses.
+	 */
+	template<int SIZE> void _display(canvas*, int, int);
+	void (car_image::*drawer)(canvas*, int, int);
+
+	public:
+	/*
+	 * Constructor, takes the size and the character from the config.
+	 */
+	car_image(const zr_config*);
+	/*
+	 * This one simply draws the car on the given canvas. It assumes
+	 * that this can clearly be done, so all the checks need to be
+	 * done earlier. The parameters it takes are the canvas and position
+	 * of upper left corner of the car.
+	 */
+	void display(canvas*, int, int);
+	/*
+	 * Draws the explosion of the car. Parameters are canvas, position
+	 * of upper left corner of the car and the RNG that shapes the blast.
+	 * Position is relative to the canvas, _not_ the track.
+	 */
+	void explode(canvas*, int, int, random_source*);
+	/*
+	 * Collision happens only when an obstacle is on a pace taken by the
+	 * car. It is possible to have the obstacle between the car's "ribs".
+	 * This checks whether given pace relative to *car's position* is
+	 * taken by the car.
+	 */
+	bool collision_check(int y, int x)
+	{
+		return storage[y][x];
+	}
+	// The columns of a row taken by the car, bit x for column x.
+	unsigned int get_mask(int y)
+	{
+		return masks[y];
+	}
+	/*
+	 * These are simple mutators.
+	 */
+	void set_character(char);
+	void set_color(int);
+
+	// And simple accessors.
+	const vector<pair<int, int> >& get_dots(void);
+	int get_size(void);
+};
+
+/*
+ * Something moving across a row of the track, a sliding rock or a crossing
+ * vehicle. Where it is depends only on the time, so it's only worked out
+ * while some view can see it. There's at most one in a row.
+ */
+struct mover
+{
+	// The row, the columns it moves within (left .. left+span-1) and its length.
+	int y, left, span, size;
+	// Turns it takes per column, how far along it starts and which way it goes.
+	int period, phase, direction;
+	// Whether it goes back and forth, or drives off and comes again from the other side.
+	bool bounce;
+	// Its leftmost column now, partly off its columns when crossing, and whether it's active.
+	int x;
+	bool shown;
+};
+
+/*
+ * What's known of a block of CHUNK_ROWS rows without looking at them.
+ * Most of a track is just the road between the kerbs, so if there are no
+ * rocks and nothing moving in a chunk, any columns within the road of
+ * all its rows are free, all the way through.
+ */
+struct row_chunk
+{
+	// The columns between the kerbs in every row of the chunk, left .. right.
+	int left, right;
+	// The rocks within those columns, and the cells of cars and movers anywhere.
+	int rocks, moving;
+};
+
+/*
+ * A car a question about the track leaves out, the one asking it: where
+ * it's marked and its image. On a shared track its own cells on the car
+ * layer aren't in its way, everything else on them still is.
+ */
+struct car_place
+{
+	int y, x;
+	car_image* car;
+};
+
+class track
+{
+	/*
+	 * These are the most important data for the game. The track should
+	 * be generated only once each game, preferably shared between players.
+	 * It's kept as one block, row after row, so it can be handed out
+	 * as a whole without copying. It only holds what was generated, the
+	 * cars are in the car layer.
+	 */
+	vector<char> circuit;
+	int length, width;
+	/*
+	 * The layers, each a bitplane of length rows of words 64 bit words,
+	 * bit j%64 of word j/64 for column j. One layer after another.
+	 */
+	vector<unsigned long long> planes;
+	int words;
+	/*
+	 * Everything a car would hit, the lethal layers in one plane, so
+	 * collisions and sensors read a word where they'd read four. It's
+	 * brought up to date whenever one of them changes.
+	 */
+	vector<unsigned long long> obstacles;
+	// The summaries of the rows, a chunk each.
+	vector<row_chunk> chunks;
+	// Whether there's anything on the surface layers at all.
+	bool surfaces;
+	/*
+	 * The movers, from the start to the finish as they were generated.
+	 * The ones some view can see are active and drawn in the mover
+	 * layer, the rest up from waiting are still to come.
+	 */
+	vector<mover> movers;
+	vector<int> active;
+	unsigned int waiting;
+	// On a circuit, the line the lap of the waiting one starts from.
+	int lap_line;
+	// Whether it's a circuit, the lines repeating every length rows.
+	bool loop;
+	// What the cars are marked with on a shared track.
+	char character;
+
+	// Fills the layers in from the generated circuit.
+	void _classify(void);
+	// Where the mover is at the time, and drawing it in its layer or taking it away.
+	void _place(mover&, int);
+	void _paint(const mover&, int, bool);
+	// Whether some line from the top to the bottom one is on the mover's row.
+	bool _seen(const mover&, int, int);
+	void _set(int layer, int y, int x)
+	{
+		planes[(layer*length + y)*words + x/64] |= 1ULL << x%64;
+	}
+	// The row a line is on.
+	int _wrap(int y)
+	{
+		return loop ? (y%length + length)%length : y;
+	}
+	// Whether the car at the place is all on the track.
+	bool _inside(int y, int x, int size)
+	{
+		return (loop || (0<=y && y+size<=length)) && 0<=x && x+size<=width;
+	}
+	// A row of a car at column x, in the word x/64 of a row and the next one.
+	static void _shift(unsigned long long mask, int x, unsigned long long& low, unsigned long long& high)
+	{
+		low = mask << x%64;
+		high = x%64 ? mask >> (64-x%64) : 0;
+	}
+	// Whether the chunk is known to be free from the left column to the right one.
+	bool _clear(int chunk, int left, int right)
+	{
+		const row_chunk& k = chunks[chunk];
+		return !k.rocks && !k.moving && k.left <= left && right <= k.right;
+	}
+	// Counts the cells of cars and movers coming to or leaving a row.
+	void _moving(int y, int cells)
+	{
+		chunks[y/CHUNK_ROWS].moving += cells;
+	}
+	// Brings a word of the obstacles up to date with the layers.
+	void _refresh(int y, int word)
+	{
+		const unsigned long long* plane = &planes[y*words + word];
+		const int layer = length*words;
+		obstacles[y*words + word] = plane[ZR_LAYER_KERB*layer] | plane[ZR_LAYER_ROCK*layer] |
+			plane[ZR_LAYER_CAR*layer] | plane[ZR_LAYER_MOVER*layer];
+	}
+	/*
+	 * The cells of the left out car in a word of a row, none without one.
+	 * A car can start partly off the side of the track, so it's shifted
+	 * by however far from the word it is.
+	 */
+	unsigned long long _mine(int row, int word, const car_place* own)
+	{
+		if(!own)
+			return 0;
+		int i = row - _wrap(own->y), shift = own->x - word*64;
+		if(i < 0)
+			i += length;
+		if(i >= own->car->get_size() || shift <= -64 || 64 <= shift)
+			return 0;
+		unsigned long long mask = own->car->get_mask(i);
+		return shift >= 0 ? mask << shift : mask >> -shift;
+	}
+	// What a car would hit in a word of a row, but for the left out car.
+	unsigned long long _lethal(int row, int word, const car_place* own)
+	{
+		unsigned long long found = obstacles[row*words + word];
+		unsigned long long mine = _mine(row, word, own);
+		if(mine)
+		{
+			const unsigned long long* plane = &planes[row*words + word];
+			const int layer = length*words;
+			found &= ~mine | plane[ZR_LAYER_KERB*layer] | plane[ZR_LAYER_ROCK*layer] | plane[ZR_LAYER_MOVER*layer];
+		}
+		return found;
+	}
+	// Whether the cell is on any of the layers, given as a bit set.
+	bool _on(unsigned int layers, int y, int x)
+	{
+		const unsigned long long* word = &planes[y*words + x/64];
+		unsigned long long bit = 1ULL << x%64;
+		for(int i = 0; i<ZR_LAYERS; i++)
+			if(layers & 1U<<i && word[i*length*words] & bit)
+				return true;
+		return false;
+	}
+
+	public:
+	/*
+	 * Generates the track described by the config, with the given RNG.
+	 */
+	track(const zr_config*, random_source*);
+	/*
+	 * All the lines below are lines of the race, on a circuit they're
+	 * wrapped round the track.
+	 *
+	 * Takes the canvas, the number of the top line to display and of the
+	 * column to show at its left edge, negative if the track is narrower
+	 * and should be moved right. Canvas' height and width are grabbed by
+	 * get_size(), only what fits in them is drawn, however wide the track.
+	 */
+	void display(canvas*, int, int);
+	/*
+	 * Copies the characters of a window of the track, the way display()
+	 * shows them, row after row: takes the top line, the left column, the
+	 * number of rows and columns, and the buffer. Off the track it's blank.
+	 */
+	void window(int, int, int, int, char*);
+	/*
+	 * Tells whether there's an obstacle at a given pace. Everything
+	 * outside of the track is an obstacle.
+	 */
+	bool taken(int, int);
+	/*
+	 * Tells whether the car at the given place has any of its paces on
+	 * the layers, a bit set of (1 << ZR_LAYER_*). Outside of the track
+	 * counts as being on them. The size is known at compile time like
+	 * for mark(), every row of the car is then a word or two of ANDs.
+	 * The car left out, if given, doesn't count on the car layer.
+	 */
+	template<int SIZE> bool touches(unsigned int, int, int, car_image*, const car_place* = NULL);
+	/*
+	 * Takes a place, a direction (lines and columns per cell, -1, 0 or 1)
+	 * and a range. Tells how many cells from the place on are free, the
+	 * place included, at most the range. Sideways it goes a word at
+	 * a time, the nearest obstacle found by counting zeros.
+	 */
+	int ray(int, int, int, int, int);
+	/*
+	 * Takes a line, the left and right column and a range. Tells how many
+	 * lines from the given one up to the finish have nothing a car would
+	 * hit in those columns, at most the range. Chunks known to be clear
+	 * are passed at once, so it takes a step per chunk on the open road.
+	 * The car left out, if given, isn't in the way.
+	 */
+	int clearance(int, int, int, int, const car_place* = NULL);
+
+	/*
+	 * Puts the car on the car layer at the line and the column, or takes
+	 * it off. A car is marked on every cell of it that's on the track
+	 * but a kerb or a rock: over movers and other cars too, so it's still
+	 * there when they've gone. Off the track and on the scenery there's
+	 * nothing to mark.
+	 */
+	void mark(int, int, car_image*);
+	void unmark(int, int, car_image*);
+	/*
+	 * The same, for a car of the size given at compile time, so the loops
+	 * over the image unroll. 0 means the size of the image.
+	 */
+	template<int SIZE> void mark(int, int, car_image*);
+	template<int SIZE> void unmark(int, int, car_image*);
+	/*
+	 * Moves the movers on to the given time. Takes the lines seen by the
+	 * views of the cars on the track, the top one and the one after the
+	 * last, which never go down the track. Only the movers in there are
+	 * touched, they're put into the mover layer when a view reaches them
+	 * and taken away when all have passed.
+	 */
+	void traffic(int, int, int);
+	bool has_traffic(void);
+
+	int get_length(void);
+	int get_width(void);
+	const char* get_row(int);
+	// A row of a layer, get_words() long.
+	const unsigned long long* get_plane(int, int);
+	int get_words(void);
+	bool has_surfaces(void);
+};
+
+/*
+ * Commands given to a car between its moves, with the times they were
+ * given at, a line or a column at most each. When it's full, the oldest
+ * ones are forgotten. The next move uses them up, folded into one
+ * according to the command policy. A move goes a line and a column at
+ * most too, so what adds up to more under ZR_ACCUMULATE is kept for the
+ * moves after it, as one command.
+ */
+struct command_queue
+{
+	struct entry
+	{
+		long long time;
+		signed char y, x;
+	} entries[COMMAND_QUEUE];
+	int first, count;
+
+	void clear(void);
+	void push(long long, int, int);
+	// Folds the commands with the given policy into y and x.
+	void fold(int, int&, int&);
+	// Uses up what a move with the given policy took.
+	void use(int);
+};
+
+/*
+ * The cars of a race, a field after another. The moving rule goes
+ * through each field for all the cars at once, without branches, so a
+ * step takes the same few passes however many cars there are.
+ */
+struct car_table
+{
+	vector<int> y, x, top_line, last_move;
+	vector<int> command_y, command_x;
+	vector<int> status, finish_time, moved;
+	// Where the cars were before their last move.
+	vector<int> from_y, from_x;
+	// What the track said of the move: ZR_RACING to go on, and the turns it delays the next one.
+	vector<int> outcome, delay;
+
+	void resize(int);
+};
+
+class work_pool;
+
+/*
+ * A complete race: the tracks, the cars and the time. This is where
+ * the rules live, the game only feeds it with key presses and draws it.
+ */
+class race
+{
+	zr_config config;
+	int time, racing;
+	// The track each car drives on, and the ones this race has to free.
+	vector<track*> courses;
+	vector<track*> owned;
+	car_image* car;
+	car_table table;
+	/*
+	 * What the callers see of the cars, in a buffer of theirs or in
+	 * own_cars. It's brought up to date with the table on every change.
+	 */
+	zr_car* cars;
+	vector<zr_car> own_cars;
+	vector<command_queue> queues;
+	// The laps every car has done and when, laps of them per car.
+	vector<int> laps_done, lap_times;
+
+	/*
+	 * The steps, specialized at compile time for the car size, the number
+	 * of players and track sharing of the common configurations. Zero
+	 * size or players means whatever the config says, which is what the
+	 * generic kernels do, the fallback for everything else. The kernel is
+	 * chosen once, in the constructor.
+	 */
+	template<int SIZE, int PLAYERS, bool SHARED> int _step(void);
+	int (race::*kernel)(void);
+	/*
+	 * What follows the moves on the track, in two phases. First the cars
+	 * from the first to the last but one (a block of them, any number of
+	 * blocks at a time) get the finish, the surfaces and, unless the
+	 * track is shared, the collisions. Nothing changes on the track
+	 * meanwhile. Then the cars are gone through in order, and on a
+	 * shared track unmarked, checked and marked again one after another,
+	 * as that's where they meet. Only a move that's come through all that
+	 * gets its laps. This way a step goes the same on any number of
+	 * threads.
+	 */
+	template<int SIZE, bool SHARED> void _check(int, int);
+	template<int SIZE, bool SHARED> int _move(int);
+	/*
+	 * The threads the first phase is shared between, a block of
+	 * CREW_BLOCK cars being a job of the pool, none on a single thread.
+	 */
+	work_pool* crew;
+	template<int SIZE, bool SHARED> static void _check_block(void*, int, int);
+	// Counts the laps the car has got through, at the time of the step.
+	void _lap(int);
+	// Copies the car from the table for the callers.
+	void _publish(int);
+	// The car of the index to leave out on its shared track, filled in, or NULL on its own track.
+	const car_place* _own(int, car_place&);
+	// Moves on the movers the views can see, if there are any at all.
+	void _traffic(void);
+	bool traffic;
+	// Copying would need deep copies of the tracks, so it's forbidden.
+	race(const race&);
+	race& operator=(const race&);
+
+	public:
+	/*
+	 * The config has to be resolved already. The tracks are generated
+	 * with the given seed. If the buffer is given, the car states are
+	 * kept there (one per player), otherwise the race allocates its own.
+	 */
+	race(const zr_config*, unsigned int, zr_car* = NULL);
+	~race(void);
+	/*
+	 * Race's main loop action, moves every car whose time has come.
+	 * Returns the number of cars still racing.
+	 */
+	int step(void);
+	/*
+	 * Queues an action for the car's next move, given at the given time.
+	 * Zero means nothing on that axis.
+	 */
+	void command(int, int, int, long long);
+	// Takes a car out of the race.
+	void retire(int);
+	/*
+	 * Sets the number of threads the steps are worked out on, 1 by
+	 * default. Steps come out the same with any number of them.
+	 */
+	void set_threads(int);
+	/*
+	 * Casts the car's sensor rays (ZR_RAY_*) up to the range, writes
+	 * how far they get into the buffer.
+	 */
+	void sense(int, int, int*);
+	// Whether the car moves at the next step.
+	bool due(int);
+	/*
+	 * Moves a copy of the car, of the given index, the way its next move
+	 * would go with the command it has, as if nothing else on its track
+	 * moved meanwhile. Returns what becomes of it, ZR_RACING, ZR_FINISHED
+	 * or ZR_CRASHED. The race is left as it is and nothing is allocated,
+	 * so it can be called over and over to look ahead.
+	 */
+	int advance(int, zr_car&);
+	/*
+	 * The clearance of the car's track (see track::clearance()) as the
+	 * car of the given index sees it, not in its own way on a shared
+	 * track. Takes the index, the line, the left and right column and
+	 * the range. Nothing on the track is changed to ask.
+	 */
+	int clearance(int, int, int, int, int);
+
+	int get_time(void);
+	int get_cars(void);
+	const zr_car& get_car(int);
+	const zr_car* get_car_data(void);
+	int get_laps(int);
+	const int* get_lap_times(int);
+	track* get_course(int);
+	car_image* get_car_image(void);
+	const zr_config& get_config(void);
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Environment pools - headless races served through shared memory
+ *
+ * zracer-envpool runs a number of races and trades commands for
+ * observations with a trainer in another process through a POSIX shared
+ * memory object. The object is this header, then the command slots, then
+ * the observation slots, at the offsets the header gives. Everything in
+ * it is a plain C struct of ints and chars, so the trainer only maps it
+ * and reads it in place, nothing is ever serialized.
+ *
+ * Both ways go through a ring of slots with a single writer and a single
+ * reader: the writer fills slot head % slots and bumps head, the reader
+ * takes slot tail % slots and bumps tail when it's done with it. The
+ * counters only grow (wrapping round), a ring is full when head - tail is
+ * the number of slots. Whoever waits for a counter to change spins for a
+ * while and then sleeps on it as a futex, and whoever changes it wakes
+ * the sleepers, so a step costs a few microseconds of signalling.
+ *
+ * The server starts with an observation of every race. For every slot of
+ * commands the trainer sends, a command per car, every race is stepped
+ * once and an observation slot comes back, a zr_observation per car.
+ */
+
+#ifndef ENVPOOL_H
+#define ENVPOOL_H
+
+#include "zracer.h"
+
+#define ZR_POOL_MAGIC "ZREP"
+// Bumped whenever the layout below changes.
+#define ZR_POOL_VERSION 1
+
+// The window of the track around a car: lines from the car's bottom one up, columns around its middle.
+#define ZR_POOL_ROWS 24
+#define ZR_POOL_COLUMNS 32
+
+// The counters of a ring, each on a cache line of its own.
+typedef struct zr_pool_ring
+{
+	volatile unsigned int head;
+	char head_line[60];
+	volatile unsigned int tail;
+	char tail_line[60];
+} zr_pool_ring;
+
+typedef struct zr_pool_header
+{
+	char magic[4];
+	int version;
+	// The races, the cars in each, and the ones all told, race after race.
+	int races, players, cars;
+	int rows, columns;
+	// Slots in each ring, their sizes in bytes and where the first ones start.
+	int slots;
+	int command_size, observation_size;
+	int command_offset, observation_offset;
+	// Set by whichever side leaves first, which then wakes the other one.
+	volatile int closed;
+	char header_line[12];
+	// Commands from the trainer, observations from the server.
+	zr_pool_ring commands, observations;
+} zr_pool_header;
+
+/*
+ * What a car sees after a step: the car, the lines it went up the track
+ * during the step, the race it's in and how many times that race was
+ * started over. The window has the track the way the game shows it, the
+ * cars and the movers in it. When the race is over after the step, done
+ * is set, and at the next step it starts over on another seed instead,
+ * its commands unused.
+ */
+typedef struct zr_observation
+{
+	zr_car car;
+	int lines, race, episode, done;
+	char window[ZR_POOL_ROWS][ZR_POOL_COLUMNS];
+} zr_observation;
+
+#endif
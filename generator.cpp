@@ -0,0 +1,411 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Track generators, put together from policies.
+ */
+
+#include "generator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// How a kerb that moved by the given number of columns looks.
+static char kerb_shape(int direction)
+{
+	// Different chars, depending on the kerb direction.
+	return direction > 0 ? '/' : direction < 0 ? '\\' : '|';
+}
+
+/*
+ * Width schedules.
+ */
+
+// Just the minimal width from the config, for kerbs that find their own.
+struct minimal_width
+{
+	int minimal;
+
+	void start(const zr_config* config, random_source*)
+	{
+		minimal = config->minimal_width;
+	}
+
+	int at(int)
+	{
+		return minimal;
+	}
+};
+
+// Halfway between the minimal width and the whole track, like a classic start.
+struct roomy_width
+{
+	int roomy;
+
+	void start(const zr_config* config, random_source*)
+	{
+		roomy = (config->race_width + config->minimal_width)/2;
+	}
+
+	int at(int)
+	{
+		return roomy;
+	}
+};
+
+// Roomy, but every now and then narrowing down to the minimum for a while.
+#define TUNNEL_PERIOD 80
+#define TUNNEL_LENGTH 25
+
+struct tunnel_width
+{
+	int minimal, roomy;
+
+	void start(const zr_config* config, random_source*)
+	{
+		minimal = config->minimal_width;
+		roomy = (config->race_width + config->minimal_width)/2;
+	}
+
+	int at(int row)
+	{
+		return row%TUNNEL_PERIOD < TUNNEL_LENGTH ? minimal : roomy;
+	}
+};
+
+/*
+ * Kerbs.
+ */
+
+// The original ones, each kerb drifting on its own, turning at random.
+struct drift_kerbs
+{
+	int border[2], shape[2];
+	int direction[2];
+	int width;
+	double turn_chance;
+
+	void start(const zr_config* config, random_source*, int minimal)
+	{
+		width = config->race_width;
+		turn_chance = config->turn_chance;
+		// Initially make the road halfway between minimal and maximal possible.
+		border[0] = max(1, (width - minimal)/4);
+		border[1] = min(width-1, (width*3 + minimal)/4);
+		direction[0] = direction[1] = 0;
+	}
+
+	void move(int, int minimal, random_source* random)
+	{
+		// Move the kerbs.
+		for(int i = 0; i<2; i++)
+		{
+			border[i] += direction[i];
+			shape[i] = kerb_shape(direction[i]);
+		}
+
+		// Turn the kerbs...
+		int tries = 0; // This is in case it gets to narrow and no space at once (hangs).
+		while(
+				tries++<5 &&
+				(random->uniform()<turn_chance || // If RNG wants so,
+				border[0]+direction[0] <= 0 // or no space.
+				))
+			direction[0] = random->below(3)-1;
+		if(border[1]-border[0] < minimal) // If to narrow,
+			direction[0] = -1; // Make it wider
+		// A sanity check, the meter is in the first column.
+		if(border[0]+direction[0] <= 0)
+			direction[0] = 0;
+		// And the second one.
+		tries = 0;
+		while(
+				tries++<5 &&
+				(random->uniform()<turn_chance || // If RNG wants so,
+				border[1]+direction[1] >= width // or no space.
+				))
+			direction[1] = random->below(3)-1;
+		if(border[1]-border[0] < minimal)
+			direction[1] = 1;
+		if(border[1]+direction[1] >= width)
+			direction[1] = 0;
+	}
+};
+
+/*
+ * Kerbs keeping the road of the scheduled width around a centre line.
+ * They move a column per row at most, so the kerbs stay unbroken and
+ * sudden changes of the centre line make S-bends.
+ */
+template<class CENTRE>
+struct centred_kerbs
+{
+	int border[2], shape[2];
+	int width;
+	CENTRE centre;
+
+	void _target(int row, int road, int& left, int& right)
+	{
+		road = min(road, width-2);
+		left = max(1, min(width-1-road, centre.at(row) - road/2));
+		right = left + road;
+	}
+
+	void start(const zr_config* config, random_source* random, int road)
+	{
+		width = config->race_width;
+		centre.start(config, random, road);
+		_target(config->race_length-1, road, border[0], border[1]);
+	}
+
+	void move(int row, int road, random_source*)
+	{
+		int target[2];
+		_target(row, road, target[0], target[1]);
+		for(int i = 0; i<2; i++)
+		{
+			int direction = target[i] > border[i] ? 1 : target[i] < border[i] ? -1 : 0;
+			border[i] += direction;
+			shape[i] = kerb_shape(direction);
+		}
+	}
+};
+
+// Centre lines, they get the road width the track starts with.
+struct straight_centre
+{
+	int middle;
+
+	void start(const zr_config* config, random_source*, int)
+	{
+		middle = config->race_width/2;
+	}
+
+	int at(int)
+	{
+		return middle;
+	}
+};
+
+#define CURVE_PERIOD 120.0
+
+struct sine_centre
+{
+	int middle;
+	double amplitude, phase;
+
+	void start(const zr_config* config, random_source* random, int road)
+	{
+		middle = config->race_width/2;
+		amplitude = max(0, config->race_width-2-road)/2.0;
+		phase = random->uniform()*2*M_PI;
+	}
+
+	int at(int row)
+	{
+		return middle + (int)lround(amplitude*sin(2*M_PI*row/CURVE_PERIOD + phase));
+	}
+};
+
+#define CHICANE_PERIOD 30
+
+struct chicane_centre
+{
+	int middle, offset;
+
+	void start(const zr_config* config, random_source*, int road)
+	{
+		middle = config->race_width/2;
+		offset = max(0, config->race_width-2-road)/2;
+	}
+
+	int at(int row)
+	{
+		return (row/CHICANE_PERIOD)%2 ? middle+offset : middle-offset;
+	}
+};
+
+/*
+ * Obstacles.
+ */
+
+// The original rocks, one in a row with the configured chance, anywhere.
+struct scattered_rocks
+{
+	double chance;
+
+	void start(const zr_config* config, random_source*, vector<mover>*)
+	{
+		chance = config->rock_chance;
+	}
+
+	void place(char* line, int, const int*, int width, random_source* random)
+	{
+		// Occasional rock on the track :>
+		if(random->uniform()<chance)
+			line[random->below(width)]='*';
+	}
+};
+
+// The same, but once in a while there's a field full of them on the road.
+#define FIELD_PERIOD 100
+#define FIELD_LENGTH 20
+#define FIELD_DENSITY 12
+
+struct rock_fields : scattered_rocks
+{
+	void place(char* line, int row, const int* border, int width, random_source* random)
+	{
+		if(row%FIELD_PERIOD >= FIELD_LENGTH || border[1]-border[0] < 2)
+		{
+			scattered_rocks::place(line, row, border, width, random);
+			return;
+		}
+		if(random->uniform() < min(1.0, chance*FIELD_DENSITY))
+			line[border[0] + 1 + random->below(border[1]-border[0]-1)] = '*';
+	}
+};
+
+// Rocks as ever, and now and then a strip of boost pad or slow zone across the road.
+#define PAD_CHANCE 0.03
+#define PAD_LENGTH 3
+
+struct surface_pads : scattered_rocks
+{
+	int left, right, rows;
+	char kind;
+
+	void start(const zr_config* config, random_source* random, vector<mover>* movers)
+	{
+		scattered_rocks::start(config, random, movers);
+		rows = 0;
+	}
+
+	void place(char* line, int row, const int* border, int width, random_source* random)
+	{
+		int road = border[1]-border[0]-1;
+		if(!rows && road > 1 && random->uniform() < PAD_CHANCE)
+		{
+			rows = PAD_LENGTH;
+			kind = random->below(2) ? '+' : '~';
+			int size = 1 + random->below(road);
+			left = border[0] + 1 + random->below(road-size+1);
+			right = left + size;
+		}
+		if(rows)
+		{
+			// The kerbs may move on meanwhile, they're drawn over it then.
+			rows--;
+			for(int j = max(left, 1); j<min(right, width); j++)
+				line[j] = kind;
+		}
+		scattered_rocks::place(line, row, border, width, random);
+	}
+};
+
+/*
+ * Rocks as ever, and now and then a mover: a rock sliding from kerb to
+ * kerb and back, or a vehicle crossing the road. The kerbs of the row
+ * are yet to move by a column, so the movers keep off them by one more.
+ */
+#define MOVER_CHANCE 0.05
+#define VEHICLE_SIZE 3
+
+struct traffic : scattered_rocks
+{
+	vector<mover>* movers;
+	// Where the cars start, nothing moves there.
+	int grid;
+
+	void start(const zr_config* config, random_source* random, vector<mover>* list)
+	{
+		scattered_rocks::start(config, random, list);
+		movers = list;
+		grid = config->race_length - 2*config->car_size;
+	}
+
+	void place(char* line, int row, const int* border, int width, random_source* random)
+	{
+		scattered_rocks::place(line, row, border, width, random);
+
+		int road = border[1]-border[0]-3;
+		if(row >= grid || road <= VEHICLE_SIZE || random->uniform() >= MOVER_CHANCE)
+			return;
+		mover m;
+		m.y = row;
+		m.left = border[0]+2;
+		m.span = road;
+		m.bounce = random->below(2);
+		if(m.bounce)
+		{
+			m.size = 1;
+			m.period = 2 + random->below(4);
+			m.direction = 1;
+		}
+		else
+		{
+			m.size = VEHICLE_SIZE;
+			m.period = 1 + random->below(3);
+			m.direction = random->below(2) ? 1 : -1;
+		}
+		m.phase = random->below(2*m.span);
+		m.x = m.left;
+		m.shown = false;
+		movers->push_back(m);
+	}
+};
+
+/*
+ * The generator itself, one row after another from the start. The rocks
+ * come first, so a kerb moved onto one covers it. On a circuit the kerbs
+ * have to get back where they started by the top row, which comes right
+ * before the bottom one. They're turned towards there whenever they
+ * couldn't make it otherwise, a column per row.
+ */
+template<class KERBS, class WIDTH, class OBSTACLES>
+static void generate(char* circuit, vector<mover>* movers, const zr_config* config, random_source* random)
+{
+	int length = config->race_length, width = config->race_width;
+	KERBS kerbs;
+	WIDTH road;
+	OBSTACLES obstacles;
+
+	road.start(config, random);
+	kerbs.start(config, random, road.at(length-1));
+	obstacles.start(config, random, movers);
+
+	int start[2];
+	for(int i=length-1; 0<=i; i--)
+	{
+		char* line = &circuit[i*width];
+		// Distance meter.
+		line[0]='0'+i%10;
+		obstacles.place(line, i, kerbs.border, width, random);
+		int previous[2] = {kerbs.border[0], kerbs.border[1]};
+		kerbs.move(i, road.at(i), random);
+		for(int k = 0; k<2; k++)
+			if(i == length-1)
+				start[k] = kerbs.border[k];
+			else if(config->laps > 1 && abs(kerbs.border[k] - start[k]) > i)
+			{
+				int direction = start[k] > previous[k] ? 1 : start[k] < previous[k] ? -1 : 0;
+				kerbs.border[k] = previous[k] + direction;
+				kerbs.shape[k] = kerb_shape(direction);
+			}
+		// Draw the kerbs.
+		line[kerbs.border[0]] = kerbs.shape[0];
+		line[kerbs.border[1]] = kerbs.shape[1];
+	}
+}
+
+const generator_entry generators[ZR_GENERATORS] =
+{
+	{"classic", generate<drift_kerbs, minimal_width, scattered_rocks>},
+	{"curves", generate<centred_kerbs<sine_centre>, roomy_width, scattered_rocks>},
+	{"chicanes", generate<centred_kerbs<chicane_centre>, roomy_width, scattered_rocks>},
+	{"tunnels", generate<centred_kerbs<straight_centre>, tunnel_width, scattered_rocks>},
+	{"rock fields", generate<drift_kerbs, minimal_width, rock_fields>},
+	{"surfaces", generate<centred_kerbs<sine_centre>, roomy_width, surface_pads>},
+	{"traffic", generate<centred_kerbs<straight_centre>, roomy_width, traffic>},
+};
@@ -0,0 +1,56 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Track generators, put together from policies.
+ *
+ * A track is generated row by row, from the bottom (the start) to the
+ * top (the finish). Three policies decide what goes into a row: the
+ * kerbs move the borders of the road, the width schedule tells how wide
+ * the road should be there and the obstacles put the rocks and pads.
+ * Generators are templates over the three, so each is compiled into
+ * a loop of its own with everything inlined, and the registry lists
+ * them by name.
+ *
+ * The track sorts the characters into its layers afterwards: '*' is
+ * a rock, '+' a boost pad, '~' a slow zone, anything else but a space
+ * is a kerb. The movers aren't characters, the obstacles add them to
+ * the list they're given, at most one in a row.
+ *
+ * A policy is any class with the members the generator calls:
+ *
+ * 	width:     start(config, random)
+ * 	           int at(row)             the road width at the row, the
+ * 	                                   least one for kerbs that drift
+ * 	kerbs:     start(config, random, width)
+ * 	           move(row, width, random)  moves the borders to the row
+ * 	           int border[2], shape[2]   where they are and how drawn
+ * 	obstacles: start(config, random, movers)
+ * 	           place(line, row, border, width, random)
+ *
+ * The kerbs never leave the columns 1 .. width-1, column 0 is the
+ * distance meter.
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "engine.h"
+
+/*
+ * Fills a track's circuit, race_length rows of race_width characters,
+ * and adds its movers to the list, from the start to the finish.
+ */
+typedef void (*track_generator)(char*, vector<mover>*, const zr_config*, random_source*);
+
+struct generator_entry
+{
+	const char* name;
+	track_generator generate;
+};
+
+// The registered generators, ZR_GENERATOR_* indices into it.
+extern const generator_entry generators[ZR_GENERATORS];
+
+#endif
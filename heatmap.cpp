@@ -0,0 +1,76 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Heatmaps: where the cars of many races went on a track.
+ */
+
+#include "heatmap.h"
+#include <algorithm>
+
+// Counters in a cache line.
+#define LINE_COUNTS 16
+
+heatmap::heatmap(int rows, int columns, int threads)
+{
+	length = rows;
+	width = columns;
+	shards = max(threads, 1);
+	stride = (length*width + LINE_COUNTS-1)/LINE_COUNTS*LINE_COUNTS;
+	counts.assign(shards*stride, 0);
+}
+
+void heatmap::visit(int thread, race* contest, int index)
+{
+	const zr_car& car = contest->get_car(index);
+	if(!car.moved)
+		return;
+	unsigned int* shard = &counts[thread*stride];
+	const vector<pair<int, int> >& dots = contest->get_car_image()->get_dots();
+	// On a circuit the lines go on past the track, wrapping round its rows.
+	bool loop = contest->get_config().laps > 1;
+	int top = loop ? (car.y%length + length)%length : car.y;
+	for(unsigned i = 0; i<dots.size(); i++)
+	{
+		int y = top + dots[i].first, x = car.x + dots[i].second;
+		if(loop && y >= length)
+			y -= length;
+		if(0 <= y && y < length && 0 <= x && x < width)
+			shard[y*width + x]++;
+	}
+}
+
+void heatmap::merge(void)
+{
+	unsigned int* total = &counts[0];
+	for(int i = 1; i<shards; i++)
+	{
+		unsigned int* shard = &counts[i*stride];
+		for(int j = 0; j<length*width; j++)
+		{
+			total[j] += shard[j];
+			shard[j] = 0;
+		}
+	}
+}
+
+const unsigned int* heatmap::get_row(int y)
+{
+	return &counts[y*width];
+}
+
+unsigned int heatmap::get_most(void)
+{
+	return *max_element(counts.begin(), counts.begin() + length*width);
+}
+
+int heatmap::get_length(void)
+{
+	return length;
+}
+
+int heatmap::get_width(void)
+{
+	return width;
+}
@@ -0,0 +1,47 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Heatmaps: where the cars of many races went on a track.
+ *
+ * Every move of a car counts a visit to each cell it takes, on the track
+ * row the line is on, so the counts line up with the track's own rows.
+ * They're counted in shards, one per thread of a work_pool, each a
+ * counter per cell of the track starting on a cache line of its own, so
+ * the threads never touch each other's counters and need no locks. When
+ * the races are done, merge() sums the shards up into the first one.
+ */
+
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "engine.h"
+
+class heatmap
+{
+	int length, width, shards;
+	// The shards one after another, stride counters apart.
+	vector<unsigned int> counts;
+	int stride;
+
+	public:
+	// Takes the length and width of the track and the number of threads counting.
+	heatmap(int, int, int);
+	/*
+	 * Counts the cells the car of the given index took at its last step,
+	 * if it moved then, into the shard of the given thread. Takes the
+	 * thread, the race and the car.
+	 */
+	void visit(int, race*, int);
+	// Sums the shards up, after all the visits.
+	void merge(void);
+	// A row of the merged counts, as long as the track is wide.
+	const unsigned int* get_row(int);
+	// The most visits of any cell.
+	unsigned int get_most(void);
+	int get_length(void);
+	int get_width(void);
+};
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Keyboard input for the race, an incremental decoder of the CSI
+ * (ESC [ ...) and SS3 (ESC O ...) sequences terminals send for the
+ * special keys.
+ */
+
+#include "input.h"
+#include <curses.h>
+#include <poll.h>
+#include <unistd.h>
+#include <ctime>
+#include <algorithm>
+
+using namespace std;
+
+#define KEY_ESC 27 // Missing in ncurses...
+
+// Decoder states.
+#define GROUND 0
+#define ESCAPE 1
+#define CSI 2
+#define SS3 3
+
+long long now(void)
+{
+	timespec clock;
+	clock_gettime(CLOCK_MONOTONIC, &clock);
+	return clock.tv_sec*1000000000LL + clock.tv_nsec;
+}
+
+key_decoder::key_decoder(int descriptor, int milliseconds)
+{
+	fd = descriptor;
+	set_timeout(milliseconds);
+	flush();
+}
+
+void key_decoder::set_timeout(int milliseconds)
+{
+	timeout = milliseconds*1000000LL;
+}
+
+void key_decoder::flush(void)
+{
+	start = end = 0;
+	state = GROUND;
+	parameter = 0;
+}
+
+int key_decoder::get_key(void)
+{
+	/*
+	 * A sequence that stopped half way is over, whatever comes next. A
+	 * lone ESC was the key, a sequence cut short by a slow line is dropped.
+	 */
+	if(state != GROUND && start == end && now() - escape_time >= timeout)
+	{
+		bool lone = state == ESCAPE;
+		state = GROUND;
+		return lone ? KEY_ESC : ERR;
+	}
+
+	for(;;)
+	{
+		if(start == end && !_fill())
+			return ERR;
+		int key = _feed(buffer[start++]);
+		if(key != ERR)
+			return key;
+	}
+}
+
+void key_decoder::wait(long long nanoseconds)
+{
+	// Bytes already read make a key, or they wait for more.
+	if(start != end)
+		return;
+	if(state != GROUND)
+		nanoseconds = min(nanoseconds, escape_time + timeout - now());
+	if(nanoseconds <= 0)
+		return;
+
+	pollfd request = {fd, POLLIN, 0};
+	timespec limit = {(time_t)(nanoseconds/1000000000), (long)(nanoseconds%1000000000)};
+	ppoll(&request, 1, &limit, NULL);
+}
+
+bool key_decoder::_fill(void)
+{
+	pollfd request = {fd, POLLIN, 0};
+	if(poll(&request, 1, 0) <= 0 || !(request.revents & POLLIN))
+		return false;
+
+	int got = read(fd, buffer, INPUT_BUFFER);
+	if(got <= 0)
+		return false;
+	start = 0;
+	end = got;
+	return true;
+}
+
+int key_decoder::_feed(unsigned char byte)
+{
+	switch(state)
+	{
+		case GROUND:
+			if(byte != KEY_ESC)
+				return byte;
+			state = ESCAPE;
+			escape_time = now();
+			return ERR;
+		case ESCAPE:
+			if(byte == '[' || byte == 'O')
+			{
+				state = byte == '[' ? CSI : SS3;
+				parameter = 0;
+				return ERR;
+			}
+			// Whatever it was, the previous ESC was a key of its own.
+			if(byte == KEY_ESC)
+				escape_time = now();
+			else
+			{
+				state = GROUND;
+				start--;
+			}
+			return KEY_ESC;
+		case CSI:
+			// Parameters, only the first one matters.
+			if('0' <= byte && byte <= '9')
+			{
+				if(parameter >= 0)
+					parameter = parameter*10 + byte-'0';
+				return ERR;
+			}
+			if(byte == ';' && parameter >= 0)
+				parameter = -parameter-1;
+			// More parameter and intermediate bytes are just skipped.
+			if((0x20 <= byte && byte <= 0x3F))
+				return ERR;
+			state = GROUND;
+			if(parameter < 0)
+				parameter = -parameter-1;
+			return _final(byte);
+		case SS3:
+			state = GROUND;
+			parameter = 0;
+			return _final(byte);
+	}
+	return ERR;
+}
+
+int key_decoder::_final(unsigned char byte)
+{
+	switch(byte)
+	{
+		case 'A':
+			return KEY_UP;
+		case 'B':
+			return KEY_DOWN;
+		case 'C':
+			return KEY_RIGHT;
+		case 'D':
+			return KEY_LEFT;
+		case 'H':
+			return KEY_HOME;
+		case 'F':
+			return KEY_END;
+		case '~':
+			switch(parameter)
+			{
+				case 1:
+					return KEY_HOME;
+				case 2:
+					return KEY_IC;
+				case 3:
+					return KEY_DC;
+				case 4:
+					return KEY_END;
+				case 5:
+					return KEY_PPAGE;
+				case 6:
+					return KEY_NPAGE;
+			}
+	}
+	// Nothing we know, the whole sequence is dropped.
+	return ERR;
+}
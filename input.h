@@ -0,0 +1,63 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Keyboard input for the race, read straight from the terminal.
+ *
+ * With keypad() curses waits up to ESCDELAY (a whole second by default)
+ * after every ESC, to see whether an arrow key sequence follows. This
+ * decoder reads whatever bytes are there and never waits: complete
+ * sequences are turned into curses KEY_* codes at once, and a lone ESC
+ * is reported when nothing followed it within a short timeout. A sequence
+ * that doesn't finish within it is dropped, it's no key at all.
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#define INPUT_BUFFER 64
+
+class key_decoder
+{
+	int fd;
+	// Bytes read, but not decoded yet.
+	unsigned char buffer[INPUT_BUFFER];
+	int start, end;
+	// Where in an escape sequence we are, and its first numeric parameter.
+	int state, parameter;
+	// When the current escape sequence started, and how long it may last.
+	long long escape_time, timeout;
+
+	// Reads whatever is waiting on the descriptor, never blocks.
+	bool _fill(void);
+	// Feeds a byte into the state machine, returns a key or ERR.
+	int _feed(unsigned char);
+	// Maps the final byte of a CSI or SS3 sequence to a key, or ERR.
+	int _final(unsigned char);
+
+	public:
+	/*
+	 * Takes the descriptor to read (the terminal) and the time in
+	 * milliseconds after which a lone ESC is taken for the ESC key.
+	 */
+	key_decoder(int, int);
+	/*
+	 * Returns the next complete key, or ERR when there's none (yet).
+	 * Printable keys come as they are, known sequences as KEY_* codes.
+	 */
+	int get_key(void);
+	/*
+	 * Sleeps until there's input to read, or a pending ESC times out,
+	 * but no longer than the given number of nanoseconds.
+	 */
+	void wait(long long);
+	void set_timeout(int);
+	// Forgets everything pending, including half-read sequences.
+	void flush(void);
+};
+
+// Monotonic clock in nanoseconds, the key timestamps use it.
+long long now(void);
+
+#endif
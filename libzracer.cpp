@@ -0,0 +1,323 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * The C face of the engine. The handles are just the engine objects
+ * behind an opaque type, so these are all thin wrappers. Nothing that
+ * can be called once per step allocates. The calls that do allocate
+ * catch whatever the engine throws, running out of memory mostly, as
+ * an exception mustn't get out into C.
+ */
+
+#include "zracer.h"
+#include "engine.h"
+#include "render.h"
+#include "generator.h"
+#include <algorithm>
+#include <cstring>
+
+// The handles are never anything else, these only change the type.
+static track* unwrap(zr_track* handle)
+{
+	return reinterpret_cast<track*>(handle);
+}
+
+static track* unwrap(const zr_track* handle)
+{
+	return reinterpret_cast<track*>(const_cast<zr_track*>(handle));
+}
+
+static race* unwrap(zr_race* handle)
+{
+	return reinterpret_cast<race*>(handle);
+}
+
+static race* unwrap(const zr_race* handle)
+{
+	return reinterpret_cast<race*>(const_cast<zr_race*>(handle));
+}
+
+int zr_api_version(void)
+{
+	return ZR_API_VERSION;
+}
+
+void zr_config_default(zr_config* config)
+{
+	config->race_length = 500;
+	// Zero makes these 3 variables adjusted later.
+	config->race_width = 0;
+	config->minimal_width = 0;
+	config->view_height = 0;
+	config->players = 1;
+	config->character = '^';
+	config->car_size = 10;
+	config->speed_base = 5;
+	config->rock_chance = 0.025;
+	config->turn_chance = 0.125;
+	config->similar_track = 1;
+	config->shared_track = 1;
+	config->command_policy = ZR_LAST_WINS;
+	config->generator = ZR_GENERATOR_CLASSIC;
+	config->laps = 1;
+}
+
+const char* zr_generator_name(int generator)
+{
+	if(generator < 0 || ZR_GENERATORS <= generator)
+		return NULL;
+	return generators[generator].name;
+}
+
+zr_track* zr_track_create(const zr_config* settings, unsigned int seed)
+{
+	zr_config config = *settings;
+	if(!resolve_config(&config))
+		return NULL;
+
+	random_source random(seed);
+	try
+	{
+		return reinterpret_cast<zr_track*>(new track(&config, &random));
+	}
+	catch(...)
+	{
+		return NULL;
+	}
+}
+
+void zr_track_destroy(zr_track* handle)
+{
+	delete unwrap(handle);
+}
+
+int zr_track_length(const zr_track* handle)
+{
+	return unwrap(handle)->get_length();
+}
+
+int zr_track_width(const zr_track* handle)
+{
+	return unwrap(handle)->get_width();
+}
+
+const char* zr_track_data(const zr_track* handle)
+{
+	return unwrap(handle)->get_row(0);
+}
+
+const unsigned long long* zr_track_layer(const zr_track* handle, int layer)
+{
+	if(layer < 0 || ZR_LAYERS <= layer)
+		return NULL;
+	return unwrap(handle)->get_plane(layer, 0);
+}
+
+int zr_track_layer_words(const zr_track* handle)
+{
+	return unwrap(handle)->get_words();
+}
+
+int zr_track_ray(const zr_track* handle, int y, int x, int dy, int dx, int range)
+{
+	return unwrap(handle)->ray(y, x, dy, dx, range);
+}
+
+int zr_track_clearance(const zr_track* handle, int y, int left, int right, int range)
+{
+	return unwrap(handle)->clearance(y, left, right, range);
+}
+
+int zr_track_rows(const zr_track* handle, int first, int count, char* buffer, int size)
+{
+	track* course = unwrap(handle);
+	int width = course->get_width();
+
+	// Clip the range to the track.
+	if(first < 0)
+	{
+		count += first;
+		first = 0;
+	}
+	if(course->get_length() < first+count)
+		count = course->get_length()-first;
+	if(count <= 0)
+		return 0;
+	if(size < count*width)
+		return -1;
+
+	for(int i = 0; i<count; i++)
+		memcpy(buffer + i*width, course->get_row(first+i), width);
+	return count;
+}
+
+zr_race* zr_race_create(const zr_config* settings, unsigned int seed)
+{
+	return zr_race_create_in(settings, seed, NULL);
+}
+
+zr_race* zr_race_create_in(const zr_config* settings, unsigned int seed, zr_car* cars)
+{
+	zr_config config = *settings;
+	if(!resolve_config(&config))
+		return NULL;
+
+	try
+	{
+		return reinterpret_cast<zr_race*>(new race(&config, seed, cars));
+	}
+	catch(...)
+	{
+		return NULL;
+	}
+}
+
+void zr_race_destroy(zr_race* handle)
+{
+	delete unwrap(handle);
+}
+
+int zr_race_step(zr_race* handle, const zr_command* commands)
+{
+	race* contest = unwrap(handle);
+
+	if(commands)
+		for(int i = 0; i<contest->get_cars(); i++)
+			contest->command(i, commands[i].y, commands[i].x, contest->get_time());
+	return contest->step();
+}
+
+void zr_race_command(zr_race* handle, int index, zr_command command, long long when)
+{
+	race* contest = unwrap(handle);
+
+	if(0 <= index && index < contest->get_cars())
+		contest->command(index, command.y, command.x, when);
+}
+
+int zr_race_step_many(zr_race* const* handles, int count, const zr_command* commands)
+{
+	int racing = 0;
+
+	for(int i = 0; i<count; i++)
+	{
+		racing += zr_race_step(handles[i], commands);
+		// The next race's commands follow this one's.
+		if(commands)
+			commands += unwrap(handles[i])->get_cars();
+	}
+	return racing;
+}
+
+void zr_race_set_threads(zr_race* handle, int threads)
+{
+	// Without the threads the race goes on on one, the same.
+	try
+	{
+		unwrap(handle)->set_threads(threads);
+	}
+	catch(...)
+	{
+	}
+}
+
+void zr_race_retire(zr_race* handle, int index)
+{
+	race* contest = unwrap(handle);
+
+	if(0 <= index && index < contest->get_cars())
+		contest->retire(index);
+}
+
+int zr_race_time(const zr_race* handle)
+{
+	return unwrap(handle)->get_time();
+}
+
+int zr_race_cars(const zr_race* handle)
+{
+	return unwrap(handle)->get_cars();
+}
+
+int zr_race_car_states(const zr_race* handle, zr_car* buffer, int size)
+{
+	race* contest = unwrap(handle);
+	int count = min(size, contest->get_cars());
+
+	for(int i = 0; i<count; i++)
+		buffer[i] = contest->get_car(i);
+	return count;
+}
+
+int zr_race_lap_times(const zr_race* handle, int index, int* buffer, int size)
+{
+	race* contest = unwrap(handle);
+
+	if(index < 0 || contest->get_cars() <= index)
+		return 0;
+	int done = contest->get_laps(index);
+	memcpy(buffer, contest->get_lap_times(index), max(0, min(size, done))*sizeof(int));
+	return done;
+}
+
+void zr_race_sense(const zr_race* handle, int index, int range, int* distances)
+{
+	race* contest = unwrap(handle);
+
+	if(0 <= index && index < contest->get_cars())
+		contest->sense(index, range, distances);
+	else
+		for(int i = 0; i<ZR_RAYS; i++)
+			distances[i] = 0;
+}
+
+void zr_race_sense_many(zr_race* const* handles, int count, int range, int* distances)
+{
+	for(int i = 0; i<count; i++)
+	{
+		race* contest = unwrap(handles[i]);
+		for(int j = 0; j<contest->get_cars(); j++, distances += ZR_RAYS)
+			contest->sense(j, range, distances);
+	}
+}
+
+const zr_track* zr_race_track(const zr_race* handle, int index)
+{
+	race* contest = unwrap(handle);
+
+	if(index < 0 || contest->get_cars() <= index)
+		return NULL;
+	return reinterpret_cast<zr_track*>(contest->get_course(index));
+}
+
+int zr_race_render(zr_race* handle, zr_cell* cells, int height, int width, int vertical_split, int full)
+{
+	try
+	{
+		framebuffer frame(height, width, cells);
+
+		if(full)
+			frame.clear();
+		return display_race(&frame, unwrap(handle), vertical_split, full);
+	}
+	catch(...)
+	{
+		return -1;
+	}
+}
+
+void zr_track_render(const zr_track* handle, zr_cell* cells, int height, int width, int top_line)
+{
+	try
+	{
+		framebuffer frame(height, width, cells);
+
+		frame.clear();
+		track* course = unwrap(handle);
+		course->display(&frame, top_line, camera_column(course, width, course->get_width()/2));
+	}
+	catch(...)
+	{
+	}
+}
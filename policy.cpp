@@ -0,0 +1,263 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Driving policies: small neural networks trained elsewhere, driving bots.
+ */
+
+#include "policy.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// The AVX kernel is built for any x86 and only used where it runs.
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+	(defined(__x86_64__) || defined(__i386__))
+#define POLICY_AVX
+#include <immintrin.h>
+#endif
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+static void _dense_scalar(const float* rows, const float* bias, const float* inputs, int count,
+		bool rectify, float* outputs)
+{
+	float sums[POLICY_WIDTH];
+	for(int j = 0; j<POLICY_WIDTH; j++)
+		sums[j] = bias[j];
+	for(int i = 0; i<count; i++, rows += POLICY_WIDTH)
+		if(inputs[i])
+			for(int j = 0; j<POLICY_WIDTH; j++)
+				sums[j] += inputs[i]*rows[j];
+	for(int j = 0; j<POLICY_WIDTH; j++)
+		outputs[j] = rectify ? max(sums[j], 0.0f) : sums[j];
+}
+
+// The rows are eight vectors, each sum kept in a register of its own.
+#ifdef __SSE__
+static void _dense_sse(const float* rows, const float* bias, const float* inputs, int count,
+		bool rectify, float* outputs)
+{
+	__m128 s0 = _mm_loadu_ps(bias), s1 = _mm_loadu_ps(bias+4), s2 = _mm_loadu_ps(bias+8);
+	__m128 s3 = _mm_loadu_ps(bias+12), s4 = _mm_loadu_ps(bias+16), s5 = _mm_loadu_ps(bias+20);
+	__m128 s6 = _mm_loadu_ps(bias+24), s7 = _mm_loadu_ps(bias+28);
+	for(int i = 0; i<count; i++, rows += POLICY_WIDTH)
+		if(inputs[i])
+		{
+			__m128 scale = _mm_set1_ps(inputs[i]);
+			s0 = _mm_add_ps(s0, _mm_mul_ps(scale, _mm_loadu_ps(rows)));
+			s1 = _mm_add_ps(s1, _mm_mul_ps(scale, _mm_loadu_ps(rows+4)));
+			s2 = _mm_add_ps(s2, _mm_mul_ps(scale, _mm_loadu_ps(rows+8)));
+			s3 = _mm_add_ps(s3, _mm_mul_ps(scale, _mm_loadu_ps(rows+12)));
+			s4 = _mm_add_ps(s4, _mm_mul_ps(scale, _mm_loadu_ps(rows+16)));
+			s5 = _mm_add_ps(s5, _mm_mul_ps(scale, _mm_loadu_ps(rows+20)));
+			s6 = _mm_add_ps(s6, _mm_mul_ps(scale, _mm_loadu_ps(rows+24)));
+			s7 = _mm_add_ps(s7, _mm_mul_ps(scale, _mm_loadu_ps(rows+28)));
+		}
+	if(rectify)
+	{
+		__m128 zero = _mm_setzero_ps();
+		s0 = _mm_max_ps(s0, zero);
+		s1 = _mm_max_ps(s1, zero);
+		s2 = _mm_max_ps(s2, zero);
+		s3 = _mm_max_ps(s3, zero);
+		s4 = _mm_max_ps(s4, zero);
+		s5 = _mm_max_ps(s5, zero);
+		s6 = _mm_max_ps(s6, zero);
+		s7 = _mm_max_ps(s7, zero);
+	}
+	_mm_storeu_ps(outputs, s0);
+	_mm_storeu_ps(outputs+4, s1);
+	_mm_storeu_ps(outputs+8, s2);
+	_mm_storeu_ps(outputs+12, s3);
+	_mm_storeu_ps(outputs+16, s4);
+	_mm_storeu_ps(outputs+20, s5);
+	_mm_storeu_ps(outputs+24, s6);
+	_mm_storeu_ps(outputs+28, s7);
+}
+#endif
+
+// The same with four vectors twice as wide.
+#ifdef POLICY_AVX
+__attribute__((target("avx")))
+static void _dense_avx(const float* rows, const float* bias, const float* inputs, int count,
+		bool rectify, float* outputs)
+{
+	__m256 s0 = _mm256_loadu_ps(bias), s1 = _mm256_loadu_ps(bias+8);
+	__m256 s2 = _mm256_loadu_ps(bias+16), s3 = _mm256_loadu_ps(bias+24);
+	for(int i = 0; i<count; i++, rows += POLICY_WIDTH)
+		if(inputs[i])
+		{
+			__m256 scale = _mm256_set1_ps(inputs[i]);
+			s0 = _mm256_add_ps(s0, _mm256_mul_ps(scale, _mm256_loadu_ps(rows)));
+			s1 = _mm256_add_ps(s1, _mm256_mul_ps(scale, _mm256_loadu_ps(rows+8)));
+			s2 = _mm256_add_ps(s2, _mm256_mul_ps(scale, _mm256_loadu_ps(rows+16)));
+			s3 = _mm256_add_ps(s3, _mm256_mul_ps(scale, _mm256_loadu_ps(rows+24)));
+		}
+	if(rectify)
+	{
+		__m256 zero = _mm256_setzero_ps();
+		s0 = _mm256_max_ps(s0, zero);
+		s1 = _mm256_max_ps(s1, zero);
+		s2 = _mm256_max_ps(s2, zero);
+		s3 = _mm256_max_ps(s3, zero);
+	}
+	_mm256_storeu_ps(outputs, s0);
+	_mm256_storeu_ps(outputs+8, s1);
+	_mm256_storeu_ps(outputs+16, s2);
+	_mm256_storeu_ps(outputs+24, s3);
+}
+#endif
+
+policy::policy(void)
+{
+	// Until it's loaded, all zeros, so it keeps on as it is.
+	hidden_weights.assign(POLICY_INPUTS*POLICY_WIDTH, 0);
+	hidden_bias.assign(POLICY_WIDTH, 0);
+	output_weights.assign(POLICY_HIDDEN*POLICY_WIDTH, 0);
+	output_bias.assign(POLICY_WIDTH, 0);
+
+	dense = _dense_scalar;
+	kernel = "scalar";
+#ifdef __SSE__
+	dense = _dense_sse;
+	kernel = "sse";
+#endif
+#ifdef POLICY_AVX
+	if(__builtin_cpu_supports("avx"))
+	{
+		dense = _dense_avx;
+		kernel = "avx";
+	}
+#endif
+}
+
+bool policy::load(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if(!file)
+		return false;
+	policy_header header;
+	vector<float> weights(POLICY_HIDDEN*POLICY_INPUTS + POLICY_HIDDEN + POLICY_OUTPUTS*POLICY_HIDDEN + POLICY_OUTPUTS);
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+		&& !memcmp(header.magic, POLICY_MAGIC, sizeof(header.magic))
+		&& header.version == POLICY_VERSION
+		&& header.rows == POLICY_ROWS && header.columns == POLICY_COLUMNS
+		&& header.hidden == POLICY_HIDDEN && header.outputs == POLICY_OUTPUTS
+		&& fread(&weights[0], sizeof(float), weights.size(), file) == weights.size();
+	fclose(file);
+	if(!valid)
+		return false;
+
+	// Turned around, from a row per unit to a row per input.
+	const float* w = &weights[0];
+	for(int i = 0; i<POLICY_HIDDEN; i++)
+		for(int j = 0; j<POLICY_INPUTS; j++)
+			hidden_weights[j*POLICY_WIDTH + i] = *w++;
+	for(int i = 0; i<POLICY_HIDDEN; i++)
+		hidden_bias[i] = *w++;
+	for(int i = 0; i<POLICY_OUTPUTS; i++)
+		for(int j = 0; j<POLICY_HIDDEN; j++)
+			output_weights[j*POLICY_WIDTH + i] = *w++;
+	for(int i = 0; i<POLICY_OUTPUTS; i++)
+		output_bias[i] = *w++;
+	return true;
+}
+
+const char* policy::get_kernel(void) const
+{
+	return kernel;
+}
+
+bool policy::set_kernel(const char* name)
+{
+	if(!strcmp(name, "scalar"))
+	{
+		dense = _dense_scalar;
+		kernel = "scalar";
+		return true;
+	}
+#ifdef __SSE__
+	if(!strcmp(name, "sse"))
+	{
+		dense = _dense_sse;
+		kernel = "sse";
+		return true;
+	}
+#endif
+#ifdef POLICY_AVX
+	if(!strcmp(name, "avx") && __builtin_cpu_supports("avx"))
+	{
+		dense = _dense_avx;
+		kernel = "avx";
+		return true;
+	}
+#endif
+	return false;
+}
+
+void policy::observe(race* contest, int index, float* inputs)
+{
+	const zr_car& car = contest->get_car(index);
+	const zr_config& config = contest->get_config();
+	track* course = contest->get_course(index);
+	int left = car.x + config.car_size/2 - POLICY_COLUMNS/2;
+
+	for(int i = 0; i<POLICY_ROWS; i++)
+	{
+		int y = car.y-1-i;
+		// Past the finish it's all open road, the rest of the track off it isn't.
+		for(int j = 0; j<POLICY_COLUMNS; j++)
+			*inputs++ = y >= 0 && course->taken(y, left+j);
+	}
+	*inputs = (float)(car.y - car.top_line)/config.view_height;
+}
+
+void policy::score(const float* inputs, float* outputs) const
+{
+	float hidden[POLICY_WIDTH];
+	dense(&hidden_weights[0], &hidden_bias[0], inputs, POLICY_INPUTS, true, hidden);
+	dense(&output_weights[0], &output_bias[0], hidden, POLICY_HIDDEN, false, outputs);
+}
+
+void policy::evaluate(const float* inputs, int count, int* choices) const
+{
+	float outputs[POLICY_WIDTH];
+	for(int i = 0; i<count; i++, inputs += POLICY_INPUTS)
+	{
+		score(inputs, outputs);
+		int best = 0;
+		for(int j = 1; j<POLICY_OUTPUTS; j++)
+			if(outputs[j] > outputs[best])
+				best = j;
+		choices[i] = best;
+	}
+}
+
+policy_driver::policy_driver(const policy* chosen)
+{
+	brain = chosen;
+}
+
+void policy_driver::drive(race* contest, const bool* driven)
+{
+	cars.clear();
+	for(int i = 0; i<contest->get_cars(); i++)
+		if(driven[i] && contest->due(i))
+			cars.push_back(i);
+	if(cars.empty())
+		return;
+
+	inputs.resize(cars.size()*POLICY_INPUTS);
+	choices.resize(cars.size());
+	for(unsigned i = 0; i<cars.size(); i++)
+		policy::observe(contest, cars[i], &inputs[i*POLICY_INPUTS]);
+	brain->evaluate(&inputs[0], cars.size(), &choices[0]);
+	for(unsigned i = 0; i<cars.size(); i++)
+	{
+		const int* chosen = bot_commands[choices[i]];
+		contest->command(cars[i], chosen[0], chosen[1], contest->get_time());
+	}
+}
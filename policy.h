@@ -0,0 +1,108 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Driving policies: small neural networks trained elsewhere, driving bots.
+ *
+ * A policy looks at a window of the track ahead of the car, a cell per
+ * input, 1 for anything the car would hit and 0 for open road, and at
+ * how far down the screen the car is, which is how fast it goes. One
+ * hidden layer of rectified units later, it scores each of the bot
+ * commands and the best one is given.
+ *
+ * The file is a policy_header followed by floats, the way the trainer
+ * keeps them: the hidden weights a row of inputs per hidden unit, the
+ * hidden biases, the output weights a row of hidden units per command
+ * and the output biases. The architecture is fixed, the header only has
+ * to agree with it.
+ */
+
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "engine.h"
+#include "bot.h"
+
+#define POLICY_MAGIC "ZRNN"
+#define POLICY_VERSION 1
+
+// The window: this many lines ahead of the car, this many columns around its middle.
+#define POLICY_ROWS 16
+#define POLICY_COLUMNS 16
+// The window, and the car's place on the screen.
+#define POLICY_INPUTS (POLICY_ROWS*POLICY_COLUMNS + 1)
+#define POLICY_HIDDEN 32
+#define POLICY_OUTPUTS BOT_COMMANDS
+// The rows of both layers, the commands padded to as many as the hidden units.
+#define POLICY_WIDTH POLICY_HIDDEN
+
+struct policy_header
+{
+	char magic[4];
+	int version;
+	int rows, columns, hidden, outputs;
+};
+
+class policy
+{
+	/*
+	 * The weights turned around, a row of hidden units (or of commands)
+	 * per input, so a layer is a sum of rows scaled by the
+	 * inputs, the vectors going across the row. Most of the window is
+	 * open road, its rows are skipped.
+	 */
+	vector<float> hidden_weights, hidden_bias;
+	vector<float> output_weights, output_bias;
+
+	/*
+	 * A layer: the rows, the bias, the inputs and their number, whether
+	 * to rectify, and the outputs. There's a kernel for AVX, chosen when
+	 * the processor has it, one for SSE where it's built with it, and
+	 * plain C++ for everything else.
+	 */
+	typedef void (*layer)(const float*, const float*, const float*, int, bool, float*);
+	layer dense;
+	const char* kernel;
+
+	public:
+	policy(void);
+	// Reads the weights from the file, tells whether it was a policy of this architecture.
+	bool load(const char*);
+	// The kernel the layers go through: "avx", "sse" or "scalar".
+	const char* get_kernel(void) const;
+	/*
+	 * Chooses the kernel by its name instead, tells whether there's one
+	 * of that name to run here. They all come out the same but for the
+	 * rounding.
+	 */
+	bool set_kernel(const char*);
+	// Fills in the POLICY_INPUTS inputs of the car of the given index.
+	static void observe(race*, int, float*);
+	// The scores of the commands for a car's inputs, POLICY_WIDTH of them, the rest padding.
+	void score(const float*, float*) const;
+	/*
+	 * Works out the commands for a batch of cars, from their inputs one
+	 * after another, as indexes into bot_commands. It keeps nothing, so
+	 * any number of threads can share a policy.
+	 */
+	void evaluate(const float*, int, int*) const;
+};
+
+/*
+ * Drives the cars of a race with a policy: every step, the ones due to
+ * move are looked at and evaluated as one batch.
+ */
+class policy_driver
+{
+	const policy* brain;
+	vector<float> inputs;
+	vector<int> cars, choices;
+
+	public:
+	policy_driver(const policy*);
+	// Takes a flag per car of the race, whether it's driven by the policy.
+	void drive(race*, const bool*);
+};
+
+#endif
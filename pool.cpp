@@ -0,0 +1,143 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * A pool of threads for many independent headless races.
+ */
+
+#include "pool.h"
+#include <algorithm>
+
+work_pool::work_pool(int threads)
+{
+	threads = max(threads, 1);
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&start, NULL);
+	pthread_cond_init(&done, NULL);
+	round = busy = 0;
+	quit = false;
+
+	queues.resize(threads);
+	for(int i = 0; i<threads; i++)
+	{
+		pthread_mutex_init(&queues[i].lock, NULL);
+		queues[i].front = queues[i].back = 0;
+	}
+
+	// The calling thread is the first one, it would only wait otherwise.
+	workers.resize(threads);
+	for(int i = 0; i<threads; i++)
+	{
+		workers[i].pool = this;
+		workers[i].index = i;
+	}
+	for(int i = 1; i<threads; i++)
+		pthread_create(&workers[i].thread, NULL, _work, &workers[i]);
+}
+
+work_pool::~work_pool(void)
+{
+	pthread_mutex_lock(&lock);
+	quit = true;
+	pthread_cond_broadcast(&start);
+	pthread_mutex_unlock(&lock);
+
+	for(unsigned i = 1; i<workers.size(); i++)
+		pthread_join(workers[i].thread, NULL);
+	for(unsigned i = 0; i<queues.size(); i++)
+		pthread_mutex_destroy(&queues[i].lock);
+	pthread_cond_destroy(&done);
+	pthread_cond_destroy(&start);
+	pthread_mutex_destroy(&lock);
+}
+
+void* work_pool::_work(void* argument)
+{
+	worker* self = static_cast<worker*>(argument);
+	work_pool* pool = self->pool;
+	int seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;)
+	{
+		while(pool->round == seen && !pool->quit)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if(pool->quit)
+			break;
+		seen = pool->round;
+		pthread_mutex_unlock(&pool->lock);
+
+		pool->_drain(self->index);
+
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->busy == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+int work_pool::_take(int thread)
+{
+	int taken = -1;
+	work_queue& own = queues[thread];
+
+	// Own jobs first, from the back.
+	pthread_mutex_lock(&own.lock);
+	if(own.front < own.back)
+		taken = --own.back;
+	pthread_mutex_unlock(&own.lock);
+
+	// Then somebody else's, from the front, the next thread's first.
+	for(unsigned i = 1; taken < 0 && i<queues.size(); i++)
+	{
+		work_queue& other = queues[(thread+i)%queues.size()];
+		pthread_mutex_lock(&other.lock);
+		if(other.front < other.back)
+			taken = other.front++;
+		pthread_mutex_unlock(&other.lock);
+	}
+	return taken;
+}
+
+void work_pool::_drain(int thread)
+{
+	int taken;
+	while((taken = _take(thread)) >= 0)
+		job(argument, taken, thread);
+}
+
+void work_pool::run(pool_job function, void* data, int count)
+{
+	pthread_mutex_lock(&lock);
+	job = function;
+	argument = data;
+	// A share for each thread, the first ones get the odd jobs.
+	int threads = queues.size();
+	for(int i = 0, first = 0; i<threads; i++)
+	{
+		int share = count/threads + (i < count%threads);
+		pthread_mutex_lock(&queues[i].lock);
+		queues[i].front = first;
+		queues[i].back = first += share;
+		pthread_mutex_unlock(&queues[i].lock);
+	}
+	busy = threads-1;
+	round++;
+	pthread_cond_broadcast(&start);
+	pthread_mutex_unlock(&lock);
+
+	_drain(0);
+
+	// The run is done only when all the jobs taken are.
+	pthread_mutex_lock(&lock);
+	while(busy > 0)
+		pthread_cond_wait(&done, &lock);
+	pthread_mutex_unlock(&lock);
+}
+
+int work_pool::get_threads(void)
+{
+	return queues.size();
+}
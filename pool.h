@@ -0,0 +1,77 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * A pool of threads for many independent headless races.
+ *
+ * The jobs are just numbers, the function given decides what a number
+ * means. They're split evenly between the threads at first, each taking
+ * its own from the back. A thread that runs dry steals from the front of
+ * the others, so a few long races don't keep the rest of the cores idle.
+ * The order the jobs run in is anybody's guess, so each has to keep its
+ * results apart from the others', where the caller finds them by number.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "engine.h"
+#include <pthread.h>
+
+/*
+ * A job: the argument given to run(), the job's number and the thread's,
+ * which is below get_threads(), for anything kept per thread.
+ */
+typedef void (*pool_job)(void*, int, int);
+
+class work_pool
+{
+	// The jobs of a thread not taken yet, from front to back but one.
+	struct work_queue
+	{
+		pthread_mutex_t lock;
+		int front, back;
+	};
+	// What a thread needs to know to get going.
+	struct worker
+	{
+		work_pool* pool;
+		int index;
+		pthread_t thread;
+	};
+
+	vector<work_queue> queues;
+	vector<worker> workers;
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	// Bumped for every run, that's how the workers know there's one.
+	int round;
+	// Workers still busy with the run, and whether they should leave.
+	int busy;
+	bool quit;
+
+	// The run.
+	pool_job job;
+	void* argument;
+
+	// Copying would share the threads.
+	work_pool(const work_pool&);
+	work_pool& operator=(const work_pool&);
+
+	static void* _work(void*);
+	// Takes the next job for the thread, its own or stolen. Returns -1 when none are left.
+	int _take(int);
+	// Does jobs until none are left anywhere.
+	void _drain(int);
+
+	public:
+	// Takes the number of threads, the caller's one included.
+	work_pool(int);
+	~work_pool(void);
+	// Does the jobs from 0 to the given number but one, returns when all are done.
+	void run(pool_job, void*, int);
+	int get_threads(void);
+};
+
+#endif
@@ -0,0 +1,191 @@
+"""
+The trainer's end of an environment pool served by zracer-envpool.
+
+The server's shared memory is mapped and read in place, laid out as
+envpool.h tells, so an observation slot is handed out as a ctypes array
+of Observation over the shared memory itself and nothing is copied but
+the commands:
+
+    import envpool
+    pool = envpool.Pool('zracer')
+    commands = bytearray(2 * pool.cars)
+    for step in range(1000):
+        observations = pool.receive()
+        ...
+        pool.send(commands)
+    pool.close()
+
+Waiting spins for a while and then sleeps on the counter as a futex, the
+way the server does. Linux only, as the server is, and x86 only: a
+counter is read and bumped with plain loads and stores, with no fence
+before or after, and only x86 keeps them in order with the slots they
+hand over. Elsewhere the server could see a bumped head before the
+commands under it.
+"""
+
+import ctypes
+import itertools
+import mmap
+import os
+import platform
+import time
+
+MAGIC = b'ZREP'
+VERSION = 1
+
+_FUTEX_WAIT, _FUTEX_WAKE = 0, 1
+try:
+    _SYS_FUTEX = {'x86_64': 202, 'i386': 240, 'i686': 240}[platform.machine()]
+except KeyError:
+    raise ImportError('envpool needs x86, where stores and loads keep their '
+                      'order, not %s' % platform.machine())
+# On a single core spinning only keeps the server from getting anywhere.
+_SPINS = 1000 if (os.cpu_count() or 1) > 1 else 0
+
+_libc = ctypes.CDLL(None, use_errno=True)
+_libc.syscall.restype = ctypes.c_long
+
+
+class Ring(ctypes.Structure):
+    _fields_ = [('head', ctypes.c_uint), ('head_line', ctypes.c_char * 60),
+                ('tail', ctypes.c_uint), ('tail_line', ctypes.c_char * 60)]
+
+
+class Header(ctypes.Structure):
+    _fields_ = [('magic', ctypes.c_char * 4), ('version', ctypes.c_int)] + [
+        (name, ctypes.c_int) for name in (
+            'races', 'players', 'cars', 'rows', 'columns', 'slots',
+            'command_size', 'observation_size', 'command_offset',
+            'observation_offset', 'closed')] + [
+        ('header_line', ctypes.c_char * 12),
+        ('commands', Ring), ('observations', Ring)]
+
+
+class Car(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_int) for name in (
+        'y', 'x', 'top_line', 'last_move', 'command_y', 'command_x',
+        'status', 'finish_time', 'moved')]
+
+
+def _observation(rows, columns):
+    class Observation(ctypes.Structure):
+        _fields_ = [('car', Car)] + [
+            (name, ctypes.c_int) for name in (
+                'lines', 'race', 'episode', 'done')] + [
+            ('window', ctypes.c_char * columns * rows)]
+    return Observation
+
+
+def _futex(address, operation, value):
+    _libc.syscall(_SYS_FUTEX, ctypes.c_void_p(address), operation, value,
+                  None, None, 0)
+
+
+class Closed(Exception):
+    """The server is gone."""
+
+
+class Pool(object):
+    def __init__(self, name, timeout=10):
+        path = '/dev/shm/' + name.lstrip('/')
+        # The server fills the header in last, the magic after all the rest.
+        deadline = time.time() + timeout
+        while True:
+            try:
+                with open(path, 'r+b') as file:
+                    size = os.fstat(file.fileno()).st_size
+                    if size >= ctypes.sizeof(Header):
+                        self._memory = mmap.mmap(file.fileno(), size)
+                        header = Header.from_buffer(self._memory)
+                        if header.magic == MAGIC:
+                            break
+                        del header
+                        self._memory.close()
+            except (OSError, ValueError):
+                pass
+            if time.time() > deadline:
+                raise Closed('no environment pool at %s' % path)
+            time.sleep(0.01)
+        if header.version != VERSION:
+            raise ValueError('environment pool version %d, expected %d'
+                             % (header.version, VERSION))
+        self._header = header
+        self.races, self.players = header.races, header.players
+        self.cars, self.slots = header.cars, header.slots
+        Observation = _observation(header.rows, header.columns)
+        self._observations = [
+            (Observation * self.cars).from_buffer(
+                self._memory, header.observation_offset +
+                i * header.observation_size)
+            for i in range(self.slots)]
+        self._received = False
+
+    def _address(self, ring, counter):
+        return (ctypes.addressof(getattr(self._header, ring)) +
+                getattr(Ring, counter).offset)
+
+    def _wait(self, ring, counter, changed):
+        """Waits until the counter's value makes changed() true."""
+        counters = getattr(self._header, ring)
+        for i in itertools.count():
+            value = getattr(counters, counter)
+            if changed(value):
+                return value
+            if self._header.closed:
+                raise Closed('the environment pool was closed')
+            if i >= _SPINS:
+                _futex(self._address(ring, counter), _FUTEX_WAIT, value)
+
+    def _bump(self, ring, counter):
+        # A plain store: on x86 it can't pass the stores to the slot before it.
+        counters = getattr(self._header, ring)
+        setattr(counters, counter, (getattr(counters, counter) + 1) &
+                0xFFFFFFFF)
+        _futex(self._address(ring, counter), _FUTEX_WAKE, 1 << 30)
+
+    def receive(self):
+        """
+        The next observations, an array of Observation, a car after
+        another, race after race. They stay valid until send().
+        """
+        tail = self._header.observations.tail
+        self._wait('observations', 'head', lambda head: head != tail)
+        self._received = True
+        return self._observations[tail % self.slots]
+
+    def send(self, commands):
+        """
+        Sends a command per car for the next step, 2 * cars signed
+        bytes of y and x, and lets go of the observations received.
+        """
+        if len(memoryview(commands).cast('B')) != 2 * self.cars:
+            raise ValueError('a command takes 2 bytes for each of %d cars'
+                             % self.cars)
+        head = self._header.commands.head
+        self._wait('commands', 'tail',
+                   lambda tail: (head - tail) & 0xFFFFFFFF < self.slots)
+        offset = (self._header.command_offset +
+                  head % self.slots * self._header.command_size)
+        self._memory[offset:offset + 2 * self.cars] = bytes(
+            memoryview(commands).cast('B'))
+        self._bump('commands', 'head')
+        if self._received:
+            self._received = False
+            self._bump('observations', 'tail')
+
+    def close(self):
+        """Tells the server to stop, and lets go of the shared memory."""
+        if getattr(self, '_header', None) is None:
+            return
+        self._header.closed = 1
+        _futex(self._address('commands', 'head'), _FUTEX_WAKE, 1 << 30)
+        _futex(self._address('observations', 'tail'), _FUTEX_WAKE, 1 << 30)
+        del self._observations, self._header
+        try:
+            self._memory.close()
+        except BufferError:
+            # Observations still held keep the mapping, it goes with them.
+            pass
+
+    def __del__(self):
+        self.close()
@@ -0,0 +1,337 @@
+"""
+Python bindings for libzracer.
+
+Everything goes through the C API in zracer.h with ctypes, so there is
+nothing to compile. The tracks and the car states are handed out as
+memoryviews over the library's own memory, so they never get copied and
+numpy.asarray() takes them as they are:
+
+    import zracer
+    batch = zracer.Batch(zracer.config(players=2), range(1000))
+    cars, commands = numpy.asarray(batch.cars), numpy.asarray(batch.commands)
+    while batch.step():
+        commands[:, :, 0] = zracer.ACCELERATE
+    print(cars[:, :, zracer.CAR_FIELDS.index('status')])
+
+The library is looked up in $ZRACER_LIBRARY, next to this file, one
+directory up (the build tree) and finally on the system library path.
+"""
+
+import ctypes
+import ctypes.util
+import os
+
+API_VERSION = 11
+
+RACING, FINISHED, CRASHED, RETIRED = range(4)
+ACCELERATE, BRAKE, LEFT, RIGHT = -1, 1, -1, 1
+LAST_WINS, ACCUMULATE, FIRST_WINS = range(3)
+CLASSIC, CURVES, CHICANES, TUNNELS, ROCK_FIELDS, SURFACES, TRAFFIC = range(7)
+KERB, ROCK, FINISH, BOOST, SLOW, CAR, MOVER = range(7)
+RAY_LEFT, RAY_FORWARD_LEFT, RAY_FORWARD, RAY_FORWARD_RIGHT, RAY_RIGHT = range(5)
+RAYS = 5
+
+
+class Config(ctypes.Structure):
+    _fields_ = [
+        ('race_length', ctypes.c_int),
+        ('race_width', ctypes.c_int),
+        ('minimal_width', ctypes.c_int),
+        ('players', ctypes.c_int),
+        ('character', ctypes.c_char),
+        ('car_size', ctypes.c_int),
+        ('speed_base', ctypes.c_int),
+        ('rock_chance', ctypes.c_double),
+        ('turn_chance', ctypes.c_double),
+        ('similar_track', ctypes.c_int),
+        ('shared_track', ctypes.c_int),
+        ('view_height', ctypes.c_int),
+        ('command_policy', ctypes.c_int),
+        ('generator', ctypes.c_int),
+        ('laps', ctypes.c_int),
+    ]
+
+
+class Car(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_int) for name in (
+        'y', 'x', 'top_line', 'last_move', 'command_y', 'command_x',
+        'status', 'finish_time', 'moved')]
+
+
+class Command(ctypes.Structure):
+    _fields_ = [('y', ctypes.c_byte), ('x', ctypes.c_byte)]
+
+
+class Cell(ctypes.Structure):
+    _fields_ = [('character', ctypes.c_char), ('color', ctypes.c_byte),
+                ('bold', ctypes.c_ubyte), ('unused', ctypes.c_ubyte)]
+
+
+# The columns of the car state arrays.
+CAR_FIELDS = tuple(name for name, _ in Car._fields_)
+
+
+def _load():
+    here = os.path.dirname(os.path.abspath(__file__))
+    for candidate in (os.environ.get('ZRACER_LIBRARY'),
+                      os.path.join(here, 'libzracer.so'),
+                      os.path.join(here, os.pardir, 'libzracer.so')):
+        if candidate and os.path.exists(candidate):
+            return ctypes.CDLL(candidate)
+    installed = ctypes.util.find_library('zracer')
+    if installed:
+        return ctypes.CDLL(installed)
+    raise OSError('libzracer not found, build it with make or set '
+                  'ZRACER_LIBRARY')
+
+
+_lib = _load()
+
+_signatures = {
+    'zr_api_version': (ctypes.c_int, []),
+    'zr_config_default': (None, [ctypes.POINTER(Config)]),
+    'zr_generator_name': (ctypes.c_char_p, [ctypes.c_int]),
+    'zr_track_create': (ctypes.c_void_p, [ctypes.POINTER(Config),
+                                          ctypes.c_uint]),
+    'zr_track_destroy': (None, [ctypes.c_void_p]),
+    'zr_track_length': (ctypes.c_int, [ctypes.c_void_p]),
+    'zr_track_width': (ctypes.c_int, [ctypes.c_void_p]),
+    'zr_track_data': (ctypes.c_void_p, [ctypes.c_void_p]),
+    'zr_track_layer': (ctypes.c_void_p, [ctypes.c_void_p, ctypes.c_int]),
+    'zr_track_layer_words': (ctypes.c_int, [ctypes.c_void_p]),
+    'zr_track_ray': (ctypes.c_int, [ctypes.c_void_p, ctypes.c_int,
+                                    ctypes.c_int, ctypes.c_int,
+                                    ctypes.c_int, ctypes.c_int]),
+    'zr_track_clearance': (ctypes.c_int, [ctypes.c_void_p, ctypes.c_int,
+                                          ctypes.c_int, ctypes.c_int,
+                                          ctypes.c_int]),
+    'zr_race_create_in': (ctypes.c_void_p, [ctypes.POINTER(Config),
+                                            ctypes.c_uint,
+                                            ctypes.POINTER(Car)]),
+    'zr_race_destroy': (None, [ctypes.c_void_p]),
+    'zr_race_step': (ctypes.c_int, [ctypes.c_void_p,
+                                    ctypes.POINTER(Command)]),
+    'zr_race_step_many': (ctypes.c_int, [ctypes.POINTER(ctypes.c_void_p),
+                                         ctypes.c_int,
+                                         ctypes.POINTER(Command)]),
+    'zr_race_command': (None, [ctypes.c_void_p, ctypes.c_int, Command,
+                               ctypes.c_longlong]),
+    'zr_race_set_threads': (None, [ctypes.c_void_p, ctypes.c_int]),
+    'zr_race_retire': (None, [ctypes.c_void_p, ctypes.c_int]),
+    'zr_race_time': (ctypes.c_int, [ctypes.c_void_p]),
+    'zr_race_track': (ctypes.c_void_p, [ctypes.c_void_p, ctypes.c_int]),
+    'zr_race_lap_times': (ctypes.c_int, [ctypes.c_void_p, ctypes.c_int,
+                                         ctypes.POINTER(ctypes.c_int),
+                                         ctypes.c_int]),
+    'zr_race_sense_many': (None, [ctypes.POINTER(ctypes.c_void_p),
+                                  ctypes.c_int, ctypes.c_int,
+                                  ctypes.POINTER(ctypes.c_int)]),
+    'zr_race_render': (ctypes.c_int, [ctypes.c_void_p, ctypes.POINTER(Cell),
+                                      ctypes.c_int, ctypes.c_int,
+                                      ctypes.c_int, ctypes.c_int]),
+    'zr_track_render': (None, [ctypes.c_void_p, ctypes.POINTER(Cell),
+                               ctypes.c_int, ctypes.c_int, ctypes.c_int]),
+}
+for _name, (_result, _arguments) in _signatures.items():
+    _function = getattr(_lib, _name)
+    _function.restype = _result
+    _function.argtypes = _arguments
+
+if _lib.zr_api_version() != API_VERSION:
+    raise ImportError('libzracer API version %d, expected %d'
+                      % (_lib.zr_api_version(), API_VERSION))
+
+
+def config(**settings):
+    """A Config with the library defaults, changed by the keywords."""
+    result = Config()
+    _lib.zr_config_default(ctypes.byref(result))
+    for name, value in settings.items():
+        if name == 'character' and isinstance(value, str):
+            value = value.encode()
+        setattr(result, name, value)
+    return result
+
+
+def generators():
+    """The names of the track generators, by their numbers."""
+    return [_lib.zr_generator_name(i).decode()
+            for i in range(TRAFFIC + 1)]
+
+
+def _view(owner, address, size, format, shape, readonly=False):
+    """A memoryview of foreign memory, keeping its owner alive."""
+    block = (ctypes.c_ubyte * size).from_address(address)
+    block.owner = owner
+    view = memoryview(block).cast('B').cast(format, shape)
+    return view.toreadonly() if readonly else view
+
+
+class Track(object):
+    """
+    A generated track. rows is a (length, width) view of its characters,
+    layer() a (length, words) view of a layer's bitplane, column j being
+    bit j % 64 of word j // 64.
+    """
+
+    def __init__(self, settings=None, seed=0, _handle=None, _owner=None):
+        if _handle is None:
+            _handle = _lib.zr_track_create(
+                ctypes.byref(settings or config()), seed)
+            if not _handle:
+                raise ValueError('these settings do not make a track')
+        self._handle = _handle
+        # Tracks of a race belong to it, only the standalone ones are ours.
+        self._owner = _owner
+        self.length = _lib.zr_track_length(_handle)
+        self.width = _lib.zr_track_width(_handle)
+        self.rows = _view(self, _lib.zr_track_data(_handle),
+                          self.length * self.width, 'B',
+                          (self.length, self.width), readonly=True)
+
+    def layer(self, layer):
+        """The bitplane of one of KERB, ROCK, FINISH, BOOST, SLOW, CAR or MOVER."""
+        address = _lib.zr_track_layer(self._handle, layer)
+        if not address:
+            raise IndexError('no such layer')
+        words = _lib.zr_track_layer_words(self._handle)
+        return _view(self, address, self.length * words * 8, 'Q',
+                     (self.length, words), readonly=True)
+
+    def ray(self, y, x, dy, dx, range):
+        """How many cells from (y, x) on in the direction are free."""
+        return _lib.zr_track_ray(self._handle, y, x, dy, dx, range)
+
+    def clearance(self, y, left, right, range):
+        """How many lines from y up have nothing from left to right."""
+        return _lib.zr_track_clearance(self._handle, y, left, right, range)
+
+    def __str__(self):
+        text = self.rows.tobytes().decode()
+        return '\n'.join(text[i:i + self.width]
+                         for i in range(0, len(text), self.width))
+
+    def __del__(self):
+        if self._owner is None and getattr(self, '_handle', None):
+            _lib.zr_track_destroy(self._handle)
+            self._handle = None
+
+
+class Batch(object):
+    """
+    Any number of races with the same settings, one per seed. Their car
+    states live in one array, cars is a (races, players, len(CAR_FIELDS))
+    view of it, and commands is a writable (races, players, 2) view of the
+    commands sent with the next step. step() advances all the races in a
+    single call to the library.
+    """
+
+    def __init__(self, settings=None, seeds=(0,)):
+        settings = settings or config()
+        seeds = list(seeds)
+        self.races = len(seeds)
+        self.players = settings.players
+        self._laps = max(settings.laps, 1)
+        cars = self.races * self.players
+        self._cars = (Car * cars)()
+        self._commands = (Command * cars)()
+        self._senses = (ctypes.c_int * (cars * RAYS))()
+        self._handles = (ctypes.c_void_p * self.races)()
+        for i, seed in enumerate(seeds):
+            handle = _lib.zr_race_create_in(
+                ctypes.byref(settings), seed,
+                ctypes.cast(ctypes.byref(self._cars, i * self.players *
+                                         ctypes.sizeof(Car)),
+                            ctypes.POINTER(Car)))
+            if not handle:
+                self._destroy()
+                raise ValueError('these settings do not make a race')
+            self._handles[i] = handle
+        self._make_views((self.races, self.players))
+
+    def _make_views(self, shape):
+        self.cars = _view(self, ctypes.addressof(self._cars),
+                          ctypes.sizeof(self._cars), 'i',
+                          shape + (len(CAR_FIELDS),), readonly=True)
+        self.commands = _view(self, ctypes.addressof(self._commands),
+                              ctypes.sizeof(self._commands), 'b',
+                              shape + (2,))
+
+    def step(self):
+        """Steps every race once, returns the number of cars still racing."""
+        racing = _lib.zr_race_step_many(self._handles, self.races,
+                                        self._commands)
+        # Commands are key presses, they are used up by sending them.
+        ctypes.memset(self._commands, 0, ctypes.sizeof(self._commands))
+        return racing
+
+    def command(self, race, player, y, x, timestamp):
+        """Queues a command with its own timestamp, between the steps."""
+        _lib.zr_race_command(self._handles[race], player, Command(y, x),
+                             timestamp)
+
+    def retire(self, race, player):
+        _lib.zr_race_retire(self._handles[race], player)
+
+    def set_threads(self, threads):
+        """Works the steps of every race out on that many threads."""
+        for i in range(self.races):
+            _lib.zr_race_set_threads(self._handles[i], threads)
+
+    def time(self, race=0):
+        return _lib.zr_race_time(self._handles[race])
+
+    def render(self, race=0, height=24, width=80, vertical_split=True):
+        """
+        The race the way the game would show it on a height x width
+        terminal, as a (height, width, 4) view of character, color, bold
+        and padding bytes.
+        """
+        frame = (Cell * (height * width))()
+        if _lib.zr_race_render(self._handles[race], frame, height, width,
+                               vertical_split, 1) < 0:
+            raise MemoryError('no memory to render the race')
+        return _view(frame, ctypes.addressof(frame), ctypes.sizeof(frame),
+                     'B', (height, width, 4))
+
+    def sense(self, range=64):
+        """
+        Casts the sensor rays of every car in one call, returns a
+        (races, players, RAYS) view of how far each got, up to the range.
+        The view is overwritten by the next call.
+        """
+        _lib.zr_race_sense_many(self._handles, self.races, range,
+                                self._senses)
+        return _view(self, ctypes.addressof(self._senses),
+                     ctypes.sizeof(self._senses), 'i',
+                     (self.races, self.players, RAYS), readonly=True)
+
+    def lap_times(self, race=0, player=0):
+        """The times the car finished its laps at, so far."""
+        times = (ctypes.c_int * self._laps)()
+        done = _lib.zr_race_lap_times(self._handles[race], player, times,
+                                      self._laps)
+        return list(times[:done])
+
+    def track(self, race=0, player=0):
+        """The track the given car drives on, valid as long as the batch."""
+        return Track(_handle=_lib.zr_race_track(self._handles[race], player),
+                     _owner=self)
+
+    def _destroy(self):
+        for i in range(self.races):
+            if self._handles[i]:
+                _lib.zr_race_destroy(self._handles[i])
+                self._handles[i] = None
+
+    def __del__(self):
+        if getattr(self, '_handles', None) is not None:
+            self._destroy()
+
+
+class Race(Batch):
+    """A single race, a batch of one with the race dimension dropped."""
+
+    def __init__(self, settings=None, seed=0):
+        Batch.__init__(self, settings, (seed,))
+        self._make_views((self.players,))
@@ -0,0 +1,382 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Drawing the race, on a terminal or in memory.
+ */
+
+#include "render.h"
+#include "pool.h"
+#include <algorithm>
+
+framebuffer::framebuffer(int lines, int columns, zr_cell* storage)
+{
+	height = lines;
+	width = columns;
+	if(storage)
+		cells = storage;
+	else
+	{
+		own_cells.resize(height*width);
+		cells = &own_cells[0];
+		clear();
+	}
+}
+
+void framebuffer::get_size(int& lines, int& columns)
+{
+	lines = height;
+	columns = width;
+}
+
+void framebuffer::put(int y, int x, char character, int color, bool bold)
+{
+	if(y<0 || height<=y || x<0 || width<=x)
+		return;
+
+	zr_cell& cell = cells[y*width+x];
+	cell.character = character;
+	cell.color = color;
+	cell.bold = bold;
+}
+
+void framebuffer::clear(void)
+{
+	for(int i = 0; i<height*width; i++)
+	{
+		cells[i].character = ' ';
+		cells[i].color = PALETTE_DEFAULT;
+		cells[i].bold = 0;
+		cells[i].unused = 0;
+	}
+}
+
+const zr_cell& framebuffer::at(int y, int x)
+{
+	return cells[y*width+x];
+}
+
+zr_cell* framebuffer::get_cells(void)
+{
+	return cells;
+}
+
+int framebuffer::flush(framebuffer* shown, canvas* target)
+{
+	int changed = 0;
+
+	for(int i = 0; i<height; i++)
+		for(int j = 0; j<width; j++)
+		{
+			zr_cell& cell = cells[i*width+j];
+			zr_cell& old = shown->cells[i*width+j];
+			if(cell.character == old.character && cell.color == old.color
+					&& cell.bold == old.bold)
+				continue;
+			target->put(i, j, cell.character, cell.color, cell.bold);
+			old = cell;
+			changed++;
+		}
+	return changed;
+}
+
+sub_canvas::sub_canvas(canvas* screen, int y, int x, int lines, int columns)
+{
+	parent = screen;
+	top = y;
+	left = x;
+	height = lines;
+	width = columns;
+}
+
+void sub_canvas::get_size(int& lines, int& columns)
+{
+	lines = height;
+	columns = width;
+}
+
+void sub_canvas::put(int y, int x, char character, int color, bool bold)
+{
+	// Don't spill over to the neighbours.
+	if(y<0 || height<=y || x<0 || width<=x)
+		return;
+	parent->put(top+y, left+x, character, color, bold);
+}
+
+tee_canvas::tee_canvas(canvas* one, canvas* other)
+{
+	first = one;
+	second = other;
+}
+
+void tee_canvas::get_size(int& lines, int& columns)
+{
+	first->get_size(lines, columns);
+}
+
+void tee_canvas::put(int y, int x, char character, int color, bool bold)
+{
+	first->put(y, x, character, color, bold);
+	second->put(y, x, character, color, bold);
+}
+
+void split_screen(int players, int position, bool vertical_split,
+		int screen_height, int screen_width,
+		int& top, int& left, int& height, int& width)
+{
+	width = vertical_split? screen_width/players : screen_width;
+	height = vertical_split? screen_height : screen_height/players;
+
+	if(vertical_split)
+	{
+		// Take the corresponding vertical stripe.
+		top = 0;
+		left = width*(players - position - 1);
+	}
+	else
+	{
+		// Take the corresponding horizontal stripe.
+		top = height*position;
+		left = 0;
+	}
+}
+
+int camera_column(track* course, int view_width, int centre)
+{
+	if(course->get_width() <= view_width)
+		return -((view_width - course->get_width())/2);
+	return max(0, min(course->get_width() - view_width, centre - view_width/2));
+}
+
+bool display_player(canvas* view, race* contest, int index, bool force)
+{
+	const zr_car& car = contest->get_car(index);
+
+	// Nothing changed, or there's nothing left to show.
+	if(!force && (!car.moved || car.status == ZR_FINISHED))
+		return false;
+
+	// The camera follows the car sideways, as the top line does lengthwise.
+	int height, width;
+	view->get_size(height, width);
+	track* course = contest->get_course(index);
+	int size = contest->get_car_image()->get_size();
+	int left = camera_column(course, width, car.x + size/2);
+
+	course->display(view, car.top_line, left);
+	if(car.status == ZR_CRASHED)
+	{
+		// The explosion is random, but the same for the same race.
+		random_source random(car.finish_time*contest->get_cars() + index);
+		contest->get_car_image()->explode(view, car.y-car.top_line, car.x-left, &random);
+	}
+	else
+		contest->get_car_image()->display(view, car.y-car.top_line, car.x-left);
+	return true;
+}
+
+int display_race(canvas* screen, race* contest, bool vertical_split, bool force)
+{
+	int screen_height, screen_width, drawn = 0;
+	screen->get_size(screen_height, screen_width);
+
+	for(int i = 0; i<contest->get_cars(); i++)
+	{
+		int top, left, height, width;
+		split_screen(contest->get_cars(), i, vertical_split,
+				screen_height, screen_width, top, left, height, width);
+		sub_canvas view(screen, top, left, height, width);
+		if(display_player(&view, contest, i, force))
+			drawn++;
+	}
+	return drawn;
+}
+
+track_pyramid::track_pyramid(track* course)
+{
+	heights.push_back(course->get_length());
+	widths.push_back(course->get_width());
+	levels.push_back(vector<unsigned char>(heights[0]*widths[0]));
+	for(int i = 0; i<heights[0]; i++)
+	{
+		const unsigned long long* kerbs = course->get_plane(ZR_LAYER_KERB, i);
+		const unsigned long long* rocks = course->get_plane(ZR_LAYER_ROCK, i);
+		unsigned char* row = &levels[0][i*widths[0]];
+		// The distance meter isn't an obstacle, the cars aren't on these layers.
+		for(int j = 0; j*64<widths[0]; j++)
+		{
+			unsigned long long taken = (kerbs[j] | rocks[j]) & (j ? ~0ULL : ~1ULL);
+			for(int b = 0; taken; b++, taken >>= 1)
+				row[j*64+b] = taken & 1;
+		}
+	}
+
+	// Halve until a single cell is left, rounding up.
+	while(heights.back() > 1 || widths.back() > 1)
+	{
+		int k = levels.size();
+		int below_height = heights[k-1], below_width = widths[k-1];
+		heights.push_back((below_height+1)/2);
+		widths.push_back((below_width+1)/2);
+		levels.push_back(vector<unsigned char>(heights[k]*widths[k]));
+
+		const unsigned char* below = &levels[k-1][0];
+		unsigned char* level = &levels[k][0];
+		for(int i = 0; i<below_height; i++)
+		{
+			const unsigned char* row = below + i*below_width;
+			unsigned char* up = level + (i/2)*widths[k];
+			for(int j = 0; j<below_width; j++)
+				up[j/2] |= row[j];
+		}
+	}
+}
+
+int track_pyramid::get_levels(void)
+{
+	return levels.size();
+}
+
+int track_pyramid::get_height(int level)
+{
+	return heights[level];
+}
+
+int track_pyramid::get_width(int level)
+{
+	return widths[level];
+}
+
+bool track_pyramid::at(int level, int y, int x)
+{
+	return levels[level][y*widths[level]+x];
+}
+
+int track_pyramid::fit(int lines)
+{
+	int level = 0;
+	while(level+1 < (int)levels.size() && heights[level] > lines)
+		level++;
+	return level;
+}
+
+int minimap_columns(int length, int width, int height)
+{
+	// The same halving the pyramid does, without building it.
+	while(length > height && (length > 1 || width > 1))
+	{
+		length = (length+1)/2;
+		width = (width+1)/2;
+	}
+	return width+1;
+}
+
+minimap::minimap(track* course, int height)
+	: pyramid(course)
+{
+	level = pyramid.fit(height);
+}
+
+void minimap::_restore(canvas* panel, int y, int x)
+{
+	bool obstacle = y < pyramid.get_height(level) && x < pyramid.get_width(level)
+		&& pyramid.at(level, y, x);
+	// The first column is the gap.
+	panel->put(y, x+1, obstacle ? '#' : ' ', PALETTE_DEFAULT, false);
+}
+
+void minimap::display(canvas* panel, race* contest, bool force)
+{
+	if(force)
+	{
+		for(int i = 0; i<pyramid.get_height(level); i++)
+			for(int j = 0; j<pyramid.get_width(level); j++)
+				_restore(panel, i, j);
+	}
+	else
+		for(unsigned i = 0; i<markers.size(); i++)
+			_restore(panel, markers[i].first, markers[i].second);
+
+	// Cars drawn after all the old markers are gone, they may share a cell.
+	markers.clear();
+	int size = contest->get_car_image()->get_size();
+	for(int i = 0; i<contest->get_cars(); i++)
+	{
+		const zr_car& car = contest->get_car(i);
+		// Round and round on a circuit.
+		int y = max(car.y + size/2, 0) % contest->get_course(i)->get_length() >> level;
+		int x = max(car.x + size/2, 0) >> level;
+		markers.push_back(make_pair(y, x));
+		panel->put(y, x+1, car.status == ZR_CRASHED ? '*' : '1'+i, PALETTE_YELLOW, true);
+	}
+}
+
+compositor::compositor(int threads)
+{
+	// The calling thread draws too, it would only wait otherwise.
+	crew = threads > 1 ? new work_pool(threads) : NULL;
+}
+
+compositor::~compositor(void)
+{
+	delete crew;
+}
+
+void compositor::_view(void* argument, int view, int)
+{
+	compositor* self = static_cast<compositor*>(argument);
+	int screen_height, screen_width;
+	self->screen->get_size(screen_height, screen_width);
+
+	int top, left, height, width;
+	split_screen(self->contest->get_cars(), view, self->vertical_split,
+			screen_height, screen_width, top, left, height, width);
+	sub_canvas part(self->screen, top, left, height, width);
+	if(display_player(&part, self->contest, view, self->force))
+		__sync_fetch_and_add(&self->drawn, 1);
+}
+
+int compositor::compose(canvas* target, race* racecourse, bool vertical, bool forced)
+{
+	// Not worth waking anybody up for a single view.
+	if(!crew || racecourse->get_cars() == 1)
+		return display_race(target, racecourse, vertical, forced);
+
+	screen = target;
+	contest = racecourse;
+	vertical_split = vertical;
+	force = forced;
+	drawn = 0;
+	// The threads that run out of views take the others', so the slow ones don't hold up the rest.
+	crew->run(_view, this, contest->get_cars());
+	return drawn;
+}
+
+race_screen::race_screen(race* racecourse, int height, int width, bool vertical,
+		int map_columns, int threads)
+	: frame(height, width), views(&frame, 0, 0, height, width-map_columns),
+	panel(&frame, 0, width-map_columns, height, map_columns), composer(threads)
+{
+	contest = racecourse;
+	vertical_split = vertical;
+	// The minimap shows the first player's track, with all the cars on it.
+	map = map_columns ? new minimap(contest->get_course(0), height) : NULL;
+}
+
+race_screen::~race_screen(void)
+{
+	delete map;
+}
+
+void race_screen::draw(bool force)
+{
+	composer.compose(&views, contest, vertical_split, force);
+	if(map)
+		map->display(&panel, contest, force);
+}
+
+framebuffer* race_screen::get_frame(void)
+{
+	return &frame;
+}
@@ -0,0 +1,218 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Drawing the race, on a terminal or in memory.
+ *
+ * The game draws through these functions on curses windows, everything
+ * else can draw the very same frames into a framebuffer: a grid of cells
+ * that can be compared, saved or just thrown away when benchmarking.
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "engine.h"
+
+class work_pool;
+
+/*
+ * A screen in memory. The cells are either its own, blank at first, or
+ * a buffer of the caller, row after row, taken as it is. Whatever falls
+ * outside of it is dropped, the same way curses does.
+ */
+class framebuffer : public canvas
+{
+	int height, width;
+	zr_cell* cells;
+	vector<zr_cell> own_cells;
+
+	// Copying would leave the copy pointing at the original's cells.
+	framebuffer(const framebuffer&);
+	framebuffer& operator=(const framebuffer&);
+
+	public:
+	framebuffer(int, int, zr_cell* = NULL);
+	void get_size(int&, int&);
+	void put(int, int, char, int, bool);
+	// Fills everything with blanks.
+	void clear(void);
+	const zr_cell& at(int, int);
+	zr_cell* get_cells(void);
+	/*
+	 * Puts on the target canvas only the cells that differ from the
+	 * given framebuffer of the same size, which holds what the target
+	 * shows, and brings it up to date. Returns the number of cells put.
+	 */
+	int flush(framebuffer*, canvas*);
+};
+
+/*
+ * A rectangle of another canvas, behaving like a canvas of its own.
+ * That's what a curses window is to the screen.
+ */
+class sub_canvas : public canvas
+{
+	canvas* parent;
+	int top, left, height, width;
+
+	public:
+	sub_canvas(canvas*, int, int, int, int);
+	void get_size(int&, int&);
+	void put(int, int, char, int, bool);
+};
+
+// Puts everything on two canvases at once, takes its size from the first.
+class tee_canvas : public canvas
+{
+	canvas* first;
+	canvas* second;
+
+	public:
+	tee_canvas(canvas*, canvas*);
+	void get_size(int&, int&);
+	void put(int, int, char, int, bool);
+};
+
+/*
+ * The part of a height x width screen given to a player in a split-screen
+ * game. Takes the number of players, the player, the split axis and the
+ * screen size, fills in top, left, height and width.
+ */
+void split_screen(int, int, bool, int, int, int&, int&, int&, int&);
+
+/*
+ * The column of a track to show at the left edge of a view of the given
+ * width, keeping the given column in the middle. A track narrower than
+ * the view is centred in it, the column comes out negative then. A wider
+ * one scrolls, but never past its edges.
+ */
+int camera_column(track*, int, int);
+
+/*
+ * Draws a player's view of the race, the way it looks after the last step.
+ * Unless forced to, draws only if the car moved, otherwise the canvas
+ * still shows it right. Returns whether anything was drawn.
+ */
+bool display_player(canvas*, race*, int, bool);
+
+/*
+ * Draws all the players' views of the race, split across the canvas the
+ * same way the game splits the screen. Returns how many were drawn.
+ */
+int display_race(canvas*, race*, bool, bool);
+
+/*
+ * A track at every resolution down to a single cell, computed once. The
+ * first level tells which cells of the track hold a kerb or a rock, each
+ * next one is half as long and half as wide, a cell of it being set if
+ * anything in the 2x2 block below is.
+ */
+class track_pyramid
+{
+	vector<vector<unsigned char> > levels;
+	vector<int> heights, widths;
+
+	public:
+	track_pyramid(track*);
+	int get_levels(void);
+	int get_height(int);
+	int get_width(int);
+	// Whether there's an obstacle within the cell of the level.
+	bool at(int, int, int);
+	// The most detailed level no longer than the given number of lines.
+	int fit(int);
+};
+
+/*
+ * The columns a minimap of a track of the given length and width needs
+ * on a screen of the given height, the gap next to it included.
+ */
+int minimap_columns(int, int, int);
+
+/*
+ * The whole race in a panel: the track from the most detailed level of
+ * its pyramid that fits in the panel's height, and the cars on it. Once
+ * the track is drawn, later frames only move the cars' markers.
+ */
+class minimap
+{
+	track_pyramid pyramid;
+	int level;
+	// Where the markers were drawn, so they can be taken away.
+	vector<pair<int, int> > markers;
+
+	// Puts a cell of the level, or a blank beyond it.
+	void _restore(canvas*, int, int);
+
+	public:
+	// Takes the track to show and the panel's height.
+	minimap(track*, int);
+	// Draws the panel, the track only if forced.
+	void display(canvas*, race*, bool);
+};
+
+/*
+ * Draws the players' views the way display_race() does, but several at a
+ * time on worker threads. The views are disjoint parts of the canvas, so
+ * it's safe as long as the canvas only stores what is put on it (like a
+ * framebuffer does) and nothing else touches the race meanwhile.
+ */
+class compositor
+{
+	// A view is a job of the pool, there's none for a single thread.
+	work_pool* crew;
+
+	// The frame being composed.
+	canvas* screen;
+	race* contest;
+	bool vertical_split, force;
+	// The number of views drawn so far.
+	int drawn;
+
+	// Copying would share the threads.
+	compositor(const compositor&);
+	compositor& operator=(const compositor&);
+
+	// Draws a view.
+	static void _view(void*, int, int);
+
+	public:
+	// Takes the number of threads to draw with, the caller's one included.
+	compositor(int);
+	~compositor(void);
+	// Same arguments and result as display_race().
+	int compose(canvas*, race*, bool, bool);
+};
+
+/*
+ * Everything a race shows on the screen, the way the game lays it out:
+ * the players' views split across it and the minimap, if there's one,
+ * in a panel at the right edge.
+ */
+class race_screen
+{
+	race* contest;
+	bool vertical_split;
+	framebuffer frame;
+	sub_canvas views, panel;
+	compositor composer;
+	minimap* map;
+
+	race_screen(const race_screen&);
+	race_screen& operator=(const race_screen&);
+
+	public:
+	/*
+	 * Takes the race, the screen's height and width, the split axis, the
+	 * columns of the minimap (none if zero) and the threads to draw with.
+	 */
+	race_screen(race*, int, int, bool, int, int);
+	~race_screen(void);
+	// Draws what changed in the last step, or everything if forced.
+	void draw(bool);
+	framebuffer* get_frame(void);
+};
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Input replays: everything needed to play a race again exactly.
+ */
+
+#include "replay.h"
+#include <cstring>
+
+replay_writer::replay_writer(const char* path, const zr_config* config,
+		unsigned int seed, int height, int width, bool vertical_split,
+		int minimap_columns, long long delay)
+{
+	replay_header header;
+	// The padding goes into the file too, don't leave garbage there.
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+	header.version = REPLAY_VERSION;
+	header.config = *config;
+	header.seed = seed;
+	header.height = height;
+	header.width = width;
+	header.vertical_split = vertical_split;
+	header.minimap_columns = minimap_columns;
+	header.delay = delay;
+
+	file = fopen(path, "wb");
+	if(file)
+		fwrite(&header, sizeof(header), 1, file);
+}
+
+replay_writer::~replay_writer(void)
+{
+	if(file)
+		fclose(file);
+}
+
+bool replay_writer::is_open(void)
+{
+	return file != NULL;
+}
+
+void replay_writer::_write(int time, int car, int kind, int y, int x, long long timestamp)
+{
+	if(!file)
+		return;
+
+	replay_event event;
+	memset(&event, 0, sizeof(event));
+	event.time = time;
+	event.car = car;
+	event.kind = kind;
+	event.y = y;
+	event.x = x;
+	event.timestamp = timestamp;
+	fwrite(&event, sizeof(event), 1, file);
+}
+
+void replay_writer::command(int time, int car, int y, int x, long long timestamp)
+{
+	_write(time, car, REPLAY_COMMAND, y, x, timestamp);
+}
+
+void replay_writer::retire(int time, int car)
+{
+	_write(time, car, REPLAY_RETIRE, 0, 0, 0);
+}
+
+replay_reader::replay_reader(void)
+{
+	memset(&header, 0, sizeof(header));
+	next = 0;
+}
+
+bool replay_reader::load(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if(!file)
+		return false;
+
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+		&& !memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic))
+		&& header.version == REPLAY_VERSION;
+	replay_event event;
+	events.clear();
+	while(valid && fread(&event, sizeof(event), 1, file) == 1)
+		events.push_back(event);
+	fclose(file);
+	next = 0;
+	return valid;
+}
+
+const replay_header& replay_reader::get_header(void)
+{
+	return header;
+}
+
+void replay_reader::feed(race* contest)
+{
+	for(; next<events.size() && events[next].time <= contest->get_time(); next++)
+	{
+		const replay_event& event = events[next];
+		if(event.car < 0 || contest->get_cars() <= event.car)
+			continue;
+		if(event.kind == REPLAY_RETIRE)
+			contest->retire(event.car);
+		else
+			contest->command(event.car, event.y, event.x, event.timestamp);
+	}
+}
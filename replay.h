@@ -0,0 +1,89 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * Input replays: everything needed to play a race again exactly.
+ *
+ * The race is deterministic, so a replay is just the settings, the seed
+ * and every command with the step it came before and its timestamp. The
+ * file is the header followed by the events, both as raw structs, so
+ * it's only meant to be read by the same build that wrote it.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "engine.h"
+#include <cstdio>
+
+#define REPLAY_MAGIC "ZRRP"
+#define REPLAY_VERSION 4
+
+// Event kinds.
+#define REPLAY_COMMAND 0
+#define REPLAY_RETIRE 1
+
+struct replay_header
+{
+	char magic[4];
+	int version;
+	zr_config config;
+	unsigned int seed;
+	// The screen the race was shown on, how it was split and the minimap.
+	int height, width, vertical_split, minimap_columns;
+	// Nanoseconds between two steps.
+	long long delay;
+};
+
+struct replay_event
+{
+	// The race time when it came, it applies to the next step.
+	int time;
+	int car, kind;
+	signed char y, x;
+	long long timestamp;
+};
+
+class replay_writer
+{
+	FILE* file;
+
+	replay_writer(const replay_writer&);
+	replay_writer& operator=(const replay_writer&);
+
+	void _write(int, int, int, int, int, long long);
+
+	public:
+	/*
+	 * Creates the file and writes the header into it, see replay_header
+	 * for the arguments after the path. Check is_open() afterwards.
+	 */
+	replay_writer(const char*, const zr_config*, unsigned int, int, int, bool, int, long long);
+	~replay_writer(void);
+	bool is_open(void);
+	// Same arguments as race::command(), after the race time.
+	void command(int, int, int, int, long long);
+	void retire(int, int);
+};
+
+class replay_reader
+{
+	replay_header header;
+	vector<replay_event> events;
+	// The first event not fed to the race yet.
+	unsigned int next;
+
+	public:
+	replay_reader(void);
+	// Reads the whole file, returns false if it isn't a replay of this build.
+	bool load(const char*);
+	const replay_header& get_header(void);
+	/*
+	 * Passes to the race the events that came at its current time, so
+	 * the next step sees what it saw when the race was recorded.
+	 */
+	void feed(race*);
+};
+
+#endif
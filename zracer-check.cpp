@@ -0,0 +1,796 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * zracer-check - the fast paths of the track against the plain walks
+ *
+ * track::ray() and track::clearance() go a word or a chunk at a time
+ * over the bitplanes. Here they're asked about random places on the
+ * tracks of every generator, in races with cars and movers on them, and
+ * compared with walking the same cells one by one with track::taken().
+ * A car is also given the same taps under each command policy, and has
+ * to go where the policy says, a column a move at most. And a driving
+ * policy has to score cars the same with every kernel that runs here.
+ * A car marked on a track has to be on all its cells but the kerbs and
+ * rocks, partly off the track or not, and taken off leave it as it was.
+ * On a circuit, a car that crashes mustn't have made a lap by it.
+ * The key decoder is fed what terminals send, a recorded race is played
+ * again from its replay, a race is drawn and compared with the golden
+ * frame, a big race is stepped on one thread and on three, and the same
+ * races are counted into heatmaps of different numbers of shards.
+ * Run by `make check`, it says what didn't agree and fails if anything.
+ */
+
+#include "engine.h"
+#include "bot.h"
+#include "policy.h"
+#include "input.h"
+#include "replay.h"
+#include "render.h"
+#include "heatmap.h"
+#include "pool.h"
+#include <curses.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+// Probes of each kind at every look, and the steps between the looks.
+#define PROBES 400
+#define LOOKS 8
+#define STEPS_BETWEEN 40
+// The failures told about, the rest are only counted.
+#define TOLD 10
+// Cars a policy is asked about, and how far apart its kernels may score them.
+#define POLICY_TRIES 500
+#define POLICY_TOLERANCE 1e-4
+// The circuits raced for the laps.
+#define LAP_RACES 200
+// How long a lone ESC waits for the rest of a sequence, in milliseconds.
+#define KEY_TIMEOUT 30
+#define KEY_ESC 27 // Missing in ncurses...
+// Steps of the replayed race, and of the race drawn for the golden frame.
+#define REPLAY_STEPS 3000
+#define FRAME_STEPS 150
+/*
+ * The golden frame, a hash of its cells. It changes whenever the look of
+ * the race does: the views are those of `zracer-render frame 7 150 24 80 2`
+ * with the minimap next to them. If they look right, put the hash
+ * zracer-check tells here.
+ */
+#define GOLDEN_FRAME 0x7923388fb9b4651fULL
+// The races the heatmap counts, and the most shards it's split in.
+#define HEAT_RACES 24
+#define HEAT_SHARDS 4
+
+static int failures;
+
+static void fail(const char* what, unsigned int seed, int generator, int y, int x, int expected, int got)
+{
+	if(failures++ < TOLD)
+		fprintf(stderr, "zracer-check: %s at (%d, %d), generator %d seed %u: %d instead of %d\n",
+				what, y, x, generator, seed, got, expected);
+}
+
+// A cell by cell ray, stopping at the first cell taken.
+static int walk(track* course, int y, int x, int dy, int dx, int range)
+{
+	for(int i = 0; i<range; i++)
+		if(course->taken(y + dy*i, x + dx*i))
+			return i;
+	return max(range, 0);
+}
+
+// Whether the cell is in the car's way, its own cells on the car layer aside.
+static bool blocked(track* course, bool loop, int y, int x, const car_place* own)
+{
+	int length = course->get_length();
+	if(!own || x<0 || course->get_width()<=x || (!loop && (y<0 || length<=y)))
+		return course->taken(y, x);
+	int row = (y%length + length)%length;
+	int i = row - (own->y%length + length)%length, j = x - own->x;
+	if(i < 0)
+		i += length;
+	if(i >= own->car->get_size() || j < 0 || j >= own->car->get_size() || !own->car->collision_check(i, j))
+		return course->taken(y, x);
+	const int layers[3] = {ZR_LAYER_KERB, ZR_LAYER_ROCK, ZR_LAYER_MOVER};
+	for(int l = 0; l<3; l++)
+		if(course->get_plane(layers[l], row)[x/64] >> x%64 & 1)
+			return true;
+	return false;
+}
+
+// The free lines from a line up, the band of columns looked at a cell at a time.
+static int scan(track* course, bool loop, int y, int left, int right, int range, const car_place* own)
+{
+	if(range<=0 || left<0 || course->get_width()<=right || right<left ||
+			(!loop && (y<0 || course->get_length()<=y)))
+		return 0;
+	if(!loop)
+		range = min(range, y+1);
+	for(int i = 0; i<range; i++)
+		for(int j = left; j<=right; j++)
+			if(blocked(course, loop, y-i, j, own))
+				return i;
+	return range;
+}
+
+// Whether the cell is on the track, and the bit of a layer there.
+static bool on_track(track* course, bool loop, int y, int x)
+{
+	return (loop || (0<=y && y<course->get_length())) && 0<=x && x<course->get_width();
+}
+
+static bool plane_bit(track* course, int layer, int y, int x)
+{
+	int length = course->get_length();
+	return course->get_plane(layer, (y%length + length)%length)[x/64] >> x%64 & 1;
+}
+
+static long long rays, clearances, marks;
+
+static void look(race* contest, unsigned int seed, int generator, random_source& chance)
+{
+	const zr_config& config = contest->get_config();
+	track* course = contest->get_course(0);
+	const int length = course->get_length(), width = course->get_width();
+	const bool loop = config.laps > 1;
+
+	for(int i = 0; i<PROBES; i++)
+	{
+		int y = chance.below(length+8) - 4, x = chance.below(width+4) - 2;
+		if(loop)
+			y += chance.below(3)*length - length;
+		int dy = chance.below(3) - 1, dx = chance.below(3) - 1;
+		if(!dy && !dx)
+			dy = -1;
+		int range = chance.below(160);
+		rays++;
+		int expected = walk(course, y, x, dy, dx, range), got = course->ray(y, x, dy, dx, range);
+		if(got != expected)
+			fail(dx ? dy ? "diagonal ray" : "sideways ray" : "forward ray", seed, generator, y, x, expected, got);
+	}
+
+	for(int i = 0; i<PROBES; i++)
+	{
+		int y = chance.below(length+8) - 4, left = chance.below(width+2) - 1;
+		int right = left + chance.below(3*config.car_size);
+		int range = chance.below(2*CHUNK_ROWS + 40);
+		clearances++;
+		int expected = scan(course, loop, y, left, right, range, NULL);
+		int got = course->clearance(y, left, right, range);
+		if(got != expected)
+			fail("clearance", seed, generator, y, left, expected, got);
+
+		// And as a racing car sees it, from around where it is.
+		int index = chance.below(contest->get_cars());
+		const zr_car& car = contest->get_car(index);
+		if(car.status != ZR_RACING)
+			continue;
+		car_place own = {car.y, car.x, contest->get_car_image()};
+		y = car.y + config.car_size - 1 - chance.below(4);
+		left = car.x + chance.below(2*config.car_size+1) - config.car_size;
+		right = left + config.car_size - 1;
+		clearances++;
+		expected = scan(course, loop, y, left, right, range, &own);
+		got = contest->clearance(index, y, left, right, range);
+		if(got != expected)
+			fail("clearance of a car", seed, generator, y, left, expected, got);
+	}
+
+	// A car marked anywhere, partly off the track too, and taken off again.
+	car_image* image = contest->get_car_image();
+	const int size = image->get_size();
+	for(int i = 0; i<PROBES; i++)
+	{
+		int y = chance.below(length+8) - 4, x = chance.below(width+2*size) - size;
+		bool free = true;
+		vector<bool> before(size*size);
+		for(int j = 0; j<size; j++)
+			for(int k = 0; k<size; k++)
+			{
+				before[j*size+k] = course->taken(y+j, x+k);
+				if(on_track(course, loop, y+j, x+k) && plane_bit(course, ZR_LAYER_CAR, y+j, x+k))
+					free = false;
+			}
+		// Taking off a car on top of another one would take that one off too.
+		if(!free)
+			continue;
+		marks++;
+		course->mark(y, x, image);
+		for(int j = 0; j<size; j++)
+			for(unsigned int m = image->get_mask(j); m; m &= m-1)
+			{
+				int k = __builtin_ctz(m);
+				if(!on_track(course, loop, y+j, x+k))
+					continue;
+				bool expected = !plane_bit(course, ZR_LAYER_KERB, y+j, x+k) && !plane_bit(course, ZR_LAYER_ROCK, y+j, x+k);
+				if(plane_bit(course, ZR_LAYER_CAR, y+j, x+k) != expected || !course->taken(y+j, x+k))
+					fail("car mark", seed, generator, y+j, x+k, expected, !expected);
+			}
+		course->unmark(y, x, image);
+		for(int j = 0; j<size; j++)
+			for(int k = 0; k<size; k++)
+				if(course->taken(y+j, x+k) != before[j*size+k])
+					fail("car taken off", seed, generator, y+j, x+k, before[j*size+k], !before[j*size+k]);
+	}
+}
+
+/*
+ * The same taps given to a car before its first move, under each command
+ * policy, and the columns it goes at its next moves: left three times,
+ * right and left twice, and a tap of five columns right.
+ */
+#define TAPS 3
+#define MOVES 4
+static const int taps[3][TAPS] = {{-1, -1, -1}, {1, -1, -1}, {5, 0, 0}};
+static const int columns[ZR_FIRST_WINS+1][3][MOVES] =
+{
+	// ZR_LAST_WINS
+	{{-1, 0, 0, 0}, {-1, 0, 0, 0}, {1, 0, 0, 0}},
+	// ZR_ACCUMULATE, a column a move, the rest kept for later
+	{{-1, -1, -1, 0}, {-1, 0, 0, 0}, {1, 0, 0, 0}},
+	// ZR_FIRST_WINS
+	{{-1, 0, 0, 0}, {1, 0, 0, 0}, {1, 0, 0, 0}},
+};
+
+static void check_commands(void)
+{
+	for(int policy = 0; policy<=ZR_FIRST_WINS; policy++)
+		for(int sequence = 0; sequence<3; sequence++)
+		{
+			zr_config config;
+			zr_config_default(&config);
+			config.race_width = 150;
+			config.rock_chance = 0;
+			config.turn_chance = 0;
+			config.command_policy = policy;
+			resolve_config(&config);
+			race contest(&config, 1);
+			for(int i = 0; i<TAPS; i++)
+				if(taps[sequence][i])
+					contest.command(0, 0, taps[sequence][i], i);
+
+			for(int move = 0; move<MOVES; move++)
+			{
+				int x = contest.get_car(0).x, steps = 0;
+				do
+					contest.step();
+				while(!contest.get_car(0).moved && ++steps < 100);
+				int went = contest.get_car(0).x - x;
+				if(contest.get_car(0).status != ZR_RACING || went != columns[policy][sequence][move])
+				{
+					if(failures++ < TOLD)
+						fprintf(stderr, "zracer-check: taps %d under policy %d went %d columns at move %d instead of %d\n",
+								sequence, policy, went, move+1, columns[policy][sequence][move]);
+					break;
+				}
+			}
+		}
+}
+
+/*
+ * Laps on a circuit, with the cars sharing it and crashing into each
+ * other too: a car that crashes keeps the laps it had before the move,
+ * even if it got over the line the track starts over from. Returns the
+ * crashes that would have made a lap.
+ */
+static int check_laps(random_source& chance)
+{
+	int crossed = 0;
+	for(unsigned int seed = 1; seed<=LAP_RACES; seed++)
+	{
+		zr_config config;
+		zr_config_default(&config);
+		config.players = 8;
+		config.race_length = 60;
+		config.laps = 4;
+		config.shared_track = 1;
+		resolve_config(&config);
+		race contest(&config, seed);
+		vector<steering_bot> drivers;
+		for(int i = 0; i<config.players; i++)
+			drivers.push_back(steering_bot(bot_tiers[(seed+i)%BOT_TIERS].settings));
+		vector<bot*> seats;
+		for(int i = 0; i<config.players; i++)
+			seats.push_back(&drivers[i]);
+
+		vector<int> laps(config.players);
+		int racing;
+		do
+		{
+			for(int i = 0; i<config.players; i++)
+				laps[i] = contest.get_laps(i);
+			drive_bots(&contest, &seats[0]);
+			// And swerves now and then, or hardly anybody crashes.
+			for(int i = 0; i<config.players; i++)
+				if(!chance.below(4))
+					contest.command(i, chance.below(3)-1, chance.below(3)-1, contest.get_time());
+			racing = contest.step();
+			for(int i = 0; i<config.players; i++)
+			{
+				const zr_car& c = contest.get_car(i);
+				if(!c.moved || c.status != ZR_CRASHED)
+					continue;
+				crossed += config.laps - (c.y + config.race_length-1)/config.race_length > laps[i];
+				if(contest.get_laps(i) != laps[i] && failures++ < TOLD)
+					fprintf(stderr, "zracer-check: car %d of seed %u crashed at line %d and got %d laps instead of %d\n",
+							i, seed, c.y, contest.get_laps(i), laps[i]);
+			}
+		}
+		while(racing);
+	}
+	return crossed;
+}
+
+/*
+ * Bytes a terminal may send, maybe in two reads, and the keys they have
+ * to make, a lone ESC once the timeout is over. ERR ends the keys.
+ */
+struct key_case
+{
+	const char* name;
+	const char* bytes;
+	const char* more;
+	int keys[4];
+};
+
+static const key_case key_cases[] =
+{
+	{"a letter", "a", "", {'a', ERR}},
+	{"an arrow", "\033[A", "", {KEY_UP, ERR}},
+	{"an arrow in SS3", "\033OD", "", {KEY_LEFT, ERR}},
+	{"page down", "\033[6~", "", {KEY_NPAGE, ERR}},
+	{"an arrow with ctrl", "\033[1;5C", "", {KEY_RIGHT, ERR}},
+	{"keys in a row", "x\033[Bz", "", {'x', KEY_DOWN, 'z', ERR}},
+	{"a lone ESC", "\033", "", {KEY_ESC, ERR}},
+	{"two ESCs", "\033\033", "", {KEY_ESC, KEY_ESC, ERR}},
+	{"ESC and a letter", "\033q", "", {KEY_ESC, 'q', ERR}},
+	{"a sequence cut short", "\033[1", "", {ERR}},
+	{"an unknown sequence", "\033[Zb", "", {'b', ERR}},
+	{"a sequence in two reads", "\033[", "B", {KEY_DOWN, ERR}},
+};
+
+// The keys decoded so far, and those there are after the timeout.
+static void decode(key_decoder& keys, vector<int>& got, bool late)
+{
+	if(late)
+		usleep(2*KEY_TIMEOUT*1000);
+	for(int key; (key = keys.get_key()) != ERR; )
+		got.push_back(key);
+}
+
+static int check_keys(void)
+{
+	int descriptors[2];
+	if(pipe(descriptors))
+	{
+		failures++;
+		fprintf(stderr, "zracer-check: no pipe for the keys\n");
+		return 0;
+	}
+	key_decoder keys(descriptors[0], KEY_TIMEOUT);
+	const int cases = sizeof(key_cases)/sizeof(key_cases[0]);
+	for(int i = 0; i<cases; i++)
+	{
+		const key_case& c = key_cases[i];
+		vector<int> got;
+		bool written = write(descriptors[1], c.bytes, strlen(c.bytes)) == (int)strlen(c.bytes);
+		decode(keys, got, false);
+		written = written && write(descriptors[1], c.more, strlen(c.more)) == (int)strlen(c.more);
+		decode(keys, got, false);
+		decode(keys, got, true);
+
+		vector<int> expected;
+		for(int j = 0; c.keys[j] != ERR; j++)
+			expected.push_back(c.keys[j]);
+		if((!written || got != expected) && failures++ < TOLD)
+		{
+			fprintf(stderr, "zracer-check: %s decoded to", c.name);
+			for(unsigned j = 0; j<got.size(); j++)
+				fprintf(stderr, " %d", got[j]);
+			fprintf(stderr, " instead of");
+			for(unsigned j = 0; j<expected.size(); j++)
+				fprintf(stderr, " %d", expected[j]);
+			fprintf(stderr, "\n");
+		}
+		keys.flush();
+	}
+	close(descriptors[0]);
+	close(descriptors[1]);
+	return cases;
+}
+
+/*
+ * A race on a shared circuit with commands at random, a car retired half
+ * way, recorded into a replay. Played again from the file, it has to go
+ * the very same, step after step. Returns the steps compared.
+ */
+static int check_replay(random_source& chance)
+{
+	zr_config config;
+	zr_config_default(&config);
+	config.players = 3;
+	config.race_length = 200;
+	config.laps = 2;
+	config.shared_track = 1;
+	config.command_policy = ZR_ACCUMULATE;
+	resolve_config(&config);
+	const unsigned int seed = 5;
+
+	char path[] = "/tmp/zracer-check-XXXXXX";
+	int descriptor = mkstemp(path);
+	if(descriptor < 0)
+	{
+		failures++;
+		fprintf(stderr, "zracer-check: no file for the replay\n");
+		return 0;
+	}
+	close(descriptor);
+
+	vector<zr_car> recorded;
+	{
+		replay_writer writer(path, &config, seed, 24, 80, true, 0, 50000000);
+		race contest(&config, seed);
+		long long stamp = 0;
+		do
+		{
+			for(int i = 0; i<config.players; i++)
+				if(!chance.below(3))
+				{
+					int y = chance.below(3)-1, x = chance.below(3)-1;
+					stamp += chance.below(1000);
+					writer.command(contest.get_time(), i, y, x, stamp);
+					contest.command(i, y, x, stamp);
+				}
+			if(contest.get_time() == REPLAY_STEPS/2)
+			{
+				writer.retire(contest.get_time(), 2);
+				contest.retire(2);
+			}
+			contest.step();
+			for(int i = 0; i<config.players; i++)
+				recorded.push_back(contest.get_car(i));
+		}
+		while(contest.get_time() < REPLAY_STEPS);
+	}
+
+	replay_reader reader;
+	bool loaded = reader.load(path);
+	unlink(path);
+	const replay_header& header = reader.get_header();
+	if(!loaded || header.seed != seed || memcmp(&header.config, &config, sizeof(config)))
+	{
+		failures++;
+		fprintf(stderr, "zracer-check: the replay didn't load as it was saved\n");
+		return 0;
+	}
+	race contest(&header.config, header.seed);
+	for(int step = 0; step<REPLAY_STEPS; step++)
+	{
+		reader.feed(&contest);
+		contest.step();
+		for(int i = 0; i<config.players; i++)
+			if(memcmp(&contest.get_car(i), &recorded[step*config.players + i], sizeof(zr_car)))
+			{
+				if(failures++ < TOLD)
+					fprintf(stderr, "zracer-check: the replay went another way at step %d, car %d at (%d, %d) instead of (%d, %d)\n",
+							step+1, i, contest.get_car(i).y, contest.get_car(i).x,
+							recorded[step*config.players + i].y, recorded[step*config.players + i].x);
+				return step;
+			}
+	}
+	return REPLAY_STEPS;
+}
+
+// FNV-1a over the cells of a frame.
+static unsigned long long frame_hash(framebuffer* frame)
+{
+	int height, width;
+	frame->get_size(height, width);
+	unsigned long long hash = 14695981039346656037ULL;
+	for(int i = 0; i<height; i++)
+		for(int j = 0; j<width; j++)
+		{
+			const zr_cell& cell = frame->at(i, j);
+			const unsigned char bytes[3] = {(unsigned char)cell.character, (unsigned char)cell.color, cell.bold};
+			for(int k = 0; k<3; k++)
+				hash = (hash ^ bytes[k]) * 1099511628211ULL;
+		}
+	return hash;
+}
+
+/*
+ * Two cars racing, drawn the way the game does with the minimap, only
+ * what changed every step, on a single thread and on three. The frames
+ * have to be the same every step, and the last one the golden one. A
+ * view isn't drawn again until its car moves, like it never was, so a
+ * frame from scratch would show a crashed car's view differently.
+ * Returns the last frame's hash.
+ */
+static unsigned long long check_frame(void)
+{
+	zr_config config;
+	zr_config_default(&config);
+	config.players = 2;
+	config.race_width = 40;
+	config.view_height = 24;
+	resolve_config(&config);
+	race contest(&config, 7);
+	const int map = minimap_columns(config.race_length, config.race_width, 24);
+
+	race_screen alone(&contest, 24, 80 + map, true, map, 1);
+	race_screen crew(&contest, 24, 80 + map, true, map, 3);
+	alone.draw(true);
+	crew.draw(true);
+	unsigned long long hash = frame_hash(alone.get_frame());
+	// Everybody just drives ahead, speeding up, as in zracer-render's frames.
+	for(int i = 0; i<FRAME_STEPS && contest.step(); i++)
+	{
+		for(int j = 0; j<config.players; j++)
+			contest.command(j, ACCELERATE, 0, contest.get_time());
+		alone.draw(false);
+		crew.draw(false);
+		hash = frame_hash(alone.get_frame());
+		if(hash != frame_hash(crew.get_frame()))
+		{
+			failures++;
+			fprintf(stderr, "zracer-check: the frame drawn on three threads differs at step %d\n", i+1);
+			return hash;
+		}
+	}
+	if(hash != GOLDEN_FRAME)
+	{
+		failures++;
+		fprintf(stderr, "zracer-check: the frame isn't the golden one, its hash is 0x%llxULL\n", hash);
+	}
+	return hash;
+}
+
+/*
+ * A big race on a shared track, stepped on one thread and on three, has
+ * to go the same way. Returns the steps compared.
+ */
+static int check_threads(void)
+{
+	zr_config config;
+	zr_config_default(&config);
+	config.players = 3*CREW_BLOCK + 5;
+	config.race_width = 1000;
+	config.shared_track = 1;
+	resolve_config(&config);
+	race alone(&config, 9), crew(&config, 9);
+	crew.set_threads(3);
+
+	vector<steering_bot> drivers;
+	for(int i = 0; i<config.players; i++)
+		drivers.push_back(steering_bot(bot_tiers[i%BOT_TIERS].settings));
+	vector<bot*> seats;
+	for(int i = 0; i<config.players; i++)
+		seats.push_back(&drivers[i]);
+
+	int steps = 0;
+	for(bool racing = true; racing; steps++)
+	{
+		drive_bots(&alone, &seats[0]);
+		drive_bots(&crew, &seats[0]);
+		racing = alone.step();
+		crew.step();
+		if(memcmp(alone.get_car_data(), crew.get_car_data(), config.players*sizeof(zr_car)))
+		{
+			failures++;
+			fprintf(stderr, "zracer-check: the race went another way on three threads at step %d\n", steps+1);
+			break;
+		}
+	}
+	return steps;
+}
+
+struct heat_run
+{
+	zr_config config;
+	heatmap* counts;
+};
+
+static void heat_race(void* argument, int index, int thread)
+{
+	heat_run* run = static_cast<heat_run*>(argument);
+	race contest(&run->config, 11);
+	vector<steering_bot> drivers;
+	for(int i = 0; i<run->config.players; i++)
+		drivers.push_back(steering_bot(bot_tiers[(index+i)%BOT_TIERS].settings));
+	vector<bot*> seats;
+	for(int i = 0; i<run->config.players; i++)
+		seats.push_back(&drivers[i]);
+	bool going;
+	do
+	{
+		drive_bots(&contest, &seats[0]);
+		going = contest.step();
+		for(int i = 0; i<run->config.players; i++)
+			run->counts->visit(thread, &contest, i);
+	}
+	while(going);
+}
+
+/*
+ * The same races counted into a heatmap of one shard and of more, on as
+ * many threads, have to sum up to the same counts. Returns the visits.
+ */
+static unsigned long long check_heatmap(void)
+{
+	heat_run run;
+	zr_config_default(&run.config);
+	run.config.players = 4;
+	run.config.race_length = 300;
+	run.config.race_width = 60;
+	run.config.similar_track = 1;
+	resolve_config(&run.config);
+
+	vector<unsigned int> first;
+	unsigned long long visits = 0;
+	for(int shards = 1; shards<=HEAT_SHARDS; shards++)
+	{
+		heatmap counts(run.config.race_length, run.config.race_width, shards);
+		run.counts = &counts;
+		work_pool crew(shards);
+		crew.run(heat_race, &run, HEAT_RACES);
+		counts.merge();
+
+		vector<unsigned int> merged;
+		for(int i = 0; i<counts.get_length(); i++)
+			merged.insert(merged.end(), counts.get_row(i), counts.get_row(i) + counts.get_width());
+		if(shards == 1)
+		{
+			first = merged;
+			for(unsigned i = 0; i<merged.size(); i++)
+				visits += merged[i];
+		}
+		else if(merged != first)
+		{
+			failures++;
+			fprintf(stderr, "zracer-check: the heatmap of %d shards doesn't sum up to that of one\n", shards);
+		}
+	}
+	return visits;
+}
+
+/*
+ * A policy of random weights, saved and loaded the way a trained one is,
+ * scoring cars of random inputs with every kernel there is here, each
+ * compared with plain C++. Returns the kernels compared.
+ */
+static string check_kernels(random_source& chance)
+{
+	policy_header header;
+	memcpy(header.magic, POLICY_MAGIC, sizeof(header.magic));
+	header.version = POLICY_VERSION;
+	header.rows = POLICY_ROWS;
+	header.columns = POLICY_COLUMNS;
+	header.hidden = POLICY_HIDDEN;
+	header.outputs = POLICY_OUTPUTS;
+	vector<float> weights(POLICY_HIDDEN*POLICY_INPUTS + POLICY_HIDDEN + POLICY_OUTPUTS*POLICY_HIDDEN + POLICY_OUTPUTS);
+	for(unsigned i = 0; i<weights.size(); i++)
+		weights[i] = chance.uniform() - 0.5;
+
+	char path[] = "/tmp/zracer-check-XXXXXX";
+	int descriptor = mkstemp(path);
+	FILE* file = descriptor >= 0 ? fdopen(descriptor, "wb") : NULL;
+	policy brain;
+	bool loaded = file && fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(&weights[0], sizeof(float), weights.size(), file) == weights.size();
+	if(file)
+		loaded = !fclose(file) && loaded && brain.load(path);
+	if(descriptor >= 0)
+		unlink(path);
+	if(!loaded)
+	{
+		failures++;
+		fprintf(stderr, "zracer-check: couldn't save and load a policy in %s\n", path);
+		return "";
+	}
+
+	string compared = "scalar";
+	const char* kernels[2] = {"sse", "avx"};
+	for(int k = 0; k<2; k++)
+	{
+		if(!brain.set_kernel(kernels[k]))
+			continue;
+		compared += string(", ") + kernels[k];
+		for(int i = 0; i<POLICY_TRIES; i++)
+		{
+			// Mostly open road, like the window of a car.
+			float inputs[POLICY_INPUTS], expected[POLICY_WIDTH], got[POLICY_WIDTH];
+			for(int j = 0; j<POLICY_INPUTS-1; j++)
+				inputs[j] = !chance.below(4);
+			inputs[POLICY_INPUTS-1] = chance.uniform();
+			brain.set_kernel("scalar");
+			brain.score(inputs, expected);
+			brain.set_kernel(kernels[k]);
+			brain.score(inputs, got);
+			for(int j = 0; j<POLICY_OUTPUTS; j++)
+				if(fabs(got[j] - expected[j]) > POLICY_TOLERANCE*(1 + fabs(expected[j])))
+				{
+					if(failures++ < TOLD)
+						fprintf(stderr, "zracer-check: the %s kernel scored command %d %g instead of %g\n",
+								kernels[k], j, got[j], expected[j]);
+					break;
+				}
+		}
+	}
+	return compared;
+}
+
+int main(void)
+{
+	check_commands();
+
+	random_source swerves(2);
+	int crossed = check_laps(swerves);
+	int keys = check_keys();
+	random_source commands(3);
+	int replayed = check_replay(commands);
+	unsigned long long frame = check_frame();
+	int threaded = check_threads();
+	unsigned long long visits = check_heatmap();
+
+	random_source chance(1);
+	const int widths[2] = {60, 150};
+	for(int generator = 0; generator<ZR_GENERATORS; generator++)
+		for(int variant = 0; variant<4; variant++)
+		{
+			unsigned int seed = generator*4 + variant + 1;
+			zr_config config;
+			zr_config_default(&config);
+			config.generator = generator;
+			config.players = 6;
+			config.race_length = 300;
+			config.race_width = widths[variant%2];
+			config.laps = variant/2 ? 3 : 1;
+			if(!resolve_config(&config))
+			{
+				fprintf(stderr, "zracer-check: generator %d doesn't make a track\n", generator);
+				return 1;
+			}
+
+			// The cars all on one track, so there are cars on it as well as movers.
+			race contest(&config, seed);
+			vector<steering_bot> drivers;
+			for(int i = 0; i<config.players; i++)
+				drivers.push_back(steering_bot(bot_tiers[i%BOT_TIERS].settings));
+			vector<bot*> seats;
+			for(int i = 0; i<config.players; i++)
+				seats.push_back(&drivers[i]);
+
+			for(int i = 0; i<LOOKS; i++)
+			{
+				look(&contest, seed, generator, chance);
+				for(int j = 0; j<STEPS_BETWEEN; j++)
+				{
+					drive_bots(&contest, &seats[0]);
+					contest.step();
+				}
+			}
+		}
+
+	string kernels = check_kernels(chance);
+
+	if(failures)
+	{
+		fprintf(stderr, "zracer-check: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("zracer-check: %lld rays and %lld clearances agree with the plain walks\n", rays, clearances);
+	printf("zracer-check: %lld cars marked and taken off the tracks\n", marks);
+	printf("zracer-check: the policy kernels agree: %s\n", kernels.c_str());
+	printf("zracer-check: %d crashes over a lap line didn't make the lap\n", crossed);
+	printf("zracer-check: %d key sequences decoded\n", keys);
+	printf("zracer-check: %d steps replayed the same as recorded\n", replayed);
+	printf("zracer-check: the frame is the golden one, 0x%llx\n", frame);
+	printf("zracer-check: %d steps the same on three threads\n", threaded);
+	printf("zracer-check: %llu heatmap visits the same in 1 to %d shards\n", visits, HEAT_SHARDS);
+	return 0;
+}
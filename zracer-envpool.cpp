@@ -0,0 +1,295 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * zracer-envpool - headless races for a trainer in another process
+ *
+ * Creates the shared memory object of the given name, laid out as
+ * envpool.h tells, and serves the races through it until the trainer
+ * closes it or the server is interrupted, then removes it. The races are
+ * stepped on a pool of threads, and race i starts its n-th time over on
+ * seed FIRST_SEED + n*RACES + i, so the same commands always give the
+ * same observations.
+ */
+
+#include "engine.h"
+#include "bot.h"
+#include "pool.h"
+#include "envpool.h"
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// How many times a counter is looked at before sleeping on it.
+#define SPINS 20000
+
+struct server
+{
+	zr_config config;
+	unsigned int first_seed;
+	int limit;
+	vector<race*> races;
+	vector<int> episodes;
+	vector<bool> over;
+	// The slots of the step.
+	const zr_command* commands;
+	zr_observation* observations;
+};
+
+static volatile sig_atomic_t stopping;
+// On a single core spinning only keeps the other side from getting anywhere.
+static int spins;
+
+static void stop(int)
+{
+	stopping = 1;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: zracer-envpool [-r RACES] [-p PLAYERS] [-s FIRST_SEED] [-g GENERATOR] [-l LENGTH]\n"
+			"                      [-w WIDTH] [-k SLOTS] [-j THREADS] NAME\n");
+	exit(1);
+}
+
+// Waits until the counter is something else than it was seen, or either side leaves.
+static void wait_for(zr_pool_header* shared, volatile unsigned int* counter, unsigned int seen)
+{
+	for(int i = 0; *counter == seen && !shared->closed && !stopping; i++)
+		if(i >= spins)
+			syscall(SYS_futex, counter, FUTEX_WAIT, seen, NULL, NULL, 0);
+	__sync_synchronize();
+}
+
+static void wake(volatile unsigned int* counter)
+{
+	syscall(SYS_futex, counter, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Moves the counter on, after everything written before.
+static void bump(volatile unsigned int* counter)
+{
+	__sync_synchronize();
+	++*counter;
+	wake(counter);
+}
+
+static void observe(server* pool, int index)
+{
+	race* contest = pool->races[index];
+	const int size = pool->config.car_size, players = pool->config.players;
+	for(int i = 0; i<players; i++)
+	{
+		zr_observation& seen = pool->observations[index*players + i];
+		const zr_car& car = contest->get_car(i);
+		seen.car = car;
+		seen.race = index;
+		seen.episode = pool->episodes[index];
+		seen.done = pool->over[index];
+		contest->get_course(i)->window(car.y+size-ZR_POOL_ROWS, car.x+size/2-ZR_POOL_COLUMNS/2,
+				ZR_POOL_ROWS, ZR_POOL_COLUMNS, &seen.window[0][0]);
+	}
+}
+
+static void start(server* pool, int index)
+{
+	delete pool->races[index];
+	pool->races[index] = new race(&pool->config, pool->first_seed + pool->episodes[index]*pool->races.size() + index);
+	pool->over[index] = false;
+}
+
+// A job: a step of a race, or a new start for one that's over.
+static void step_race(void* argument, int index, int)
+{
+	server* pool = static_cast<server*>(argument);
+	const int players = pool->config.players;
+	zr_observation* seen = pool->observations + index*players;
+
+	if(pool->over[index])
+	{
+		pool->episodes[index]++;
+		start(pool, index);
+		for(int i = 0; i<players; i++)
+			seen[i].lines = 0;
+		observe(pool, index);
+		return;
+	}
+
+	race* contest = pool->races[index];
+	const zr_command* given = pool->commands + index*players;
+	for(int i = 0; i<players; i++)
+	{
+		contest->command(i, given[i].y, given[i].x, contest->get_time());
+		seen[i].lines = contest->get_car(i).y;
+	}
+	bool going = contest->step();
+	// A race nobody gets anywhere in is called off like a bot's heat.
+	if(going && contest->get_time() >= pool->limit)
+	{
+		for(int i = 0; i<players; i++)
+			contest->retire(i);
+		going = false;
+	}
+	for(int i = 0; i<players; i++)
+		seen[i].lines -= contest->get_car(i).y;
+	pool->over[index] = !going;
+	observe(pool, index);
+}
+
+int main(int argc, char** argv)
+{
+	int races = 64, slots = 2, threads = 1;
+	server pool;
+	pool.first_seed = 1;
+	zr_config_default(&pool.config);
+	pool.config.players = 1;
+	pool.config.race_width = 80;
+
+	int option;
+	while((option = getopt(argc, argv, "r:p:s:g:l:w:k:j:")) != -1)
+		switch(option)
+		{
+			case 'r':
+				races = atoi(optarg);
+				break;
+			case 'p':
+				pool.config.players = atoi(optarg);
+				break;
+			case 's':
+				pool.first_seed = atoi(optarg);
+				break;
+			case 'g':
+				pool.config.generator = atoi(optarg);
+				break;
+			case 'l':
+				pool.config.race_length = atoi(optarg);
+				break;
+			case 'w':
+				pool.config.race_width = atoi(optarg);
+				break;
+			case 'k':
+				slots = atoi(optarg);
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			default:
+				usage();
+		}
+	if(optind != argc-1 || races < 1 || slots < 1)
+		usage();
+	if(!resolve_config(&pool.config))
+	{
+		fprintf(stderr, "zracer-envpool: these settings don't make a track\n");
+		return 1;
+	}
+	pool.limit = STEPS_PER_LINE*pool.config.race_length*pool.config.laps;
+	spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPINS : 0;
+
+	// The header, then the slots, each starting on a cache line.
+	int cars = races*pool.config.players;
+	int command_size = (cars*sizeof(zr_command) + 63)/64*64;
+	int observation_size = (cars*sizeof(zr_observation) + 63)/64*64;
+	int command_offset = sizeof(zr_pool_header);
+	int observation_offset = command_offset + slots*command_size;
+	size_t total = observation_offset + (size_t)slots*observation_size;
+
+	// The name for shm_open() starts with a slash, for the trainer it doesn't have to.
+	string name = argv[optind];
+	if(name[0] != '/')
+		name = "/" + name;
+	int descriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(descriptor < 0 || ftruncate(descriptor, total))
+	{
+		fprintf(stderr, "zracer-envpool: couldn't create %s\n", name.c_str());
+		return 1;
+	}
+	char* memory = static_cast<char*>(mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0));
+	close(descriptor);
+	if(memory == MAP_FAILED)
+	{
+		shm_unlink(name.c_str());
+		fprintf(stderr, "zracer-envpool: couldn't map %s\n", name.c_str());
+		return 1;
+	}
+
+	// Interrupted, the server leaves the way it would when closed.
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	pool.races.assign(races, NULL);
+	pool.episodes.assign(races, 0);
+	pool.over.assign(races, false);
+	for(int i = 0; i<races; i++)
+		start(&pool, i);
+
+	zr_pool_header* shared = reinterpret_cast<zr_pool_header*>(memory);
+	shared->races = races;
+	shared->players = pool.config.players;
+	shared->cars = cars;
+	shared->rows = ZR_POOL_ROWS;
+	shared->columns = ZR_POOL_COLUMNS;
+	shared->slots = slots;
+	shared->command_size = command_size;
+	shared->observation_size = observation_size;
+	shared->command_offset = command_offset;
+	shared->observation_offset = observation_offset;
+
+	// The start of every race, then the header is good to go.
+	pool.observations = reinterpret_cast<zr_observation*>(memory + observation_offset);
+	for(int i = 0; i<cars; i++)
+		pool.observations[i].lines = 0;
+	for(int i = 0; i<races; i++)
+		observe(&pool, i);
+	shared->version = ZR_POOL_VERSION;
+	__sync_synchronize();
+	memcpy(shared->magic, ZR_POOL_MAGIC, sizeof(shared->magic));
+	bump(&shared->observations.head);
+
+	work_pool crew(threads);
+	long long steps = 0;
+	for(;;)
+	{
+		// The trainer's next commands, and room for what comes of them.
+		unsigned int taken = shared->commands.tail;
+		wait_for(shared, &shared->commands.head, taken);
+		unsigned int given = shared->observations.head;
+		while(given - shared->observations.tail == (unsigned int)slots && !shared->closed && !stopping)
+			wait_for(shared, &shared->observations.tail, shared->observations.tail);
+		if(shared->closed || stopping)
+			break;
+
+		pool.commands = reinterpret_cast<const zr_command*>(memory + command_offset + taken%slots*command_size);
+		pool.observations = reinterpret_cast<zr_observation*>(memory + observation_offset +
+				given%slots*observation_size);
+		crew.run(step_race, &pool, races);
+		steps++;
+
+		bump(&shared->commands.tail);
+		bump(&shared->observations.head);
+	}
+
+	// A trainer still waiting has to know.
+	shared->closed = 1;
+	wake(&shared->observations.head);
+	wake(&shared->commands.tail);
+	munmap(memory, total);
+	shm_unlink(name.c_str());
+	for(int i = 0; i<races; i++)
+		delete pool.races[i];
+	fprintf(stderr, "zracer-envpool: %lld steps of %d races served\n", steps, races);
+	return 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * zracer-evolve - breeds the settings of a bot tier
+ *
+ * A population of steering bot settings drives each of a set of seeded
+ * tracks, the heats run on a pool of threads. The best quarter of the
+ * population goes on to the next generation as it is, the rest are
+ * mutated crossings of the better ones. Each tier is after something
+ * else: a careful bot is only to get there, a reckless one to get there
+ * fast. Everything random comes from the seed and the generation, and
+ * each heat's result is kept apart, so the same seed always breeds the
+ * same bots, whatever the number of threads. After every generation the
+ * population is saved, and a run given the same file carries on from it.
+ */
+
+#include "engine.h"
+#include "bot.h"
+#include "pool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <unistd.h>
+
+#define GENES 5
+
+// How the settings are bred: their bounds, and how far a mutation goes at most.
+struct gene
+{
+	const char* name;
+	int least, most, step;
+};
+
+static const gene genes[GENES] =
+{
+	{"range", 4, 96, 8},
+	{"accelerate", 0, 96, 8},
+	{"brake", 0, 48, 4},
+	{"swerve", 0, 16, 2},
+	{"reach", 0, 40, 4},
+};
+
+// How much getting there sooner counts, for each of the bot tiers in their order.
+static const double tier_pace[BOT_TIERS] = {0, 1, 4};
+
+struct candidate
+{
+	bot_settings settings;
+	// Summed over the tracks, and negative while it's not known.
+	double fitness;
+	int finished;
+};
+
+struct evolution
+{
+	zr_config config;
+	unsigned int first_seed;
+	int tracks, tier;
+	vector<candidate> population;
+	// The heats, a row of tracks for each candidate, and the ones to run.
+	vector<zr_car> results;
+	vector<int> steps, jobs;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: zracer-evolve [-j THREADS] [-n TRACKS] [-s FIRST_SEED] [-g GENERATOR]\n"
+			"                     [-l LENGTH] [-w WIDTH] [-p POPULATION] [-e GENERATIONS]\n"
+			"                     [-r RANDOM_SEED] [-c CHECKPOINT] TIER\n"
+			"The tier is one of ");
+	for(int i = 0; i<BOT_TIERS; i++)
+		fprintf(stderr, i ? ", %s" : "%s", bot_tiers[i].name);
+	fprintf(stderr, ".\n");
+	exit(1);
+}
+
+static int& allele(bot_settings& settings, int index)
+{
+	switch(index)
+	{
+		case 0:
+			return settings.range;
+		case 1:
+			return settings.accelerate;
+		case 2:
+			return settings.brake;
+		case 3:
+			return settings.swerve;
+		default:
+			return settings.reach;
+	}
+}
+
+// Moves a gene or more by up to their step, keeping them in bounds.
+static void mutate(bot_settings& settings, random_source& chance)
+{
+	int first = chance.below(GENES);
+	for(int i = 0; i<GENES; i++)
+		if(i == first || chance.below(3) == 0)
+		{
+			int& value = allele(settings, i);
+			value += chance.below(2*genes[i].step+1) - genes[i].step;
+			value = max(genes[i].least, min(genes[i].most, value));
+		}
+}
+
+/*
+ * What a heat is worth: how much of the race the car got through, one
+ * more for finishing it, and the lines it did per step, by the tier's pace.
+ */
+static double score(const evolution* run, const zr_car& car)
+{
+	int lines = run->config.race_length*run->config.laps;
+	if(car.status == ZR_FINISHED)
+		return 2 + tier_pace[run->tier]*lines/max(car.finish_time, 1);
+	return max(0.0, min(1.0, (double)(lines - car.y)/lines));
+}
+
+static void run_heat(void* argument, int index, int)
+{
+	evolution* run = static_cast<evolution*>(argument);
+	int heat = run->jobs[index];
+	steering_bot driver(run->population[heat/run->tracks].settings);
+	run->results[heat] = solo_heat(&run->config, run->first_seed + heat%run->tracks, &driver, &run->steps[heat]);
+}
+
+/*
+ * Races the candidates not raced yet, returns the steps taken. The sums
+ * go track by track, so they come out the same bit for bit.
+ */
+static long long evaluate(evolution* run, work_pool* pool)
+{
+	int count = run->population.size()*run->tracks;
+	run->results.resize(count);
+	run->steps.assign(count, 0);
+	run->jobs.clear();
+	for(int i = 0; i<count; i++)
+		if(run->population[i/run->tracks].fitness < 0)
+			run->jobs.push_back(i);
+	pool->run(run_heat, run, run->jobs.size());
+
+	long long steps = 0;
+	for(unsigned i = 0; i<run->population.size(); i++)
+	{
+		candidate& c = run->population[i];
+		if(c.fitness >= 0)
+			continue;
+		c.fitness = 0;
+		c.finished = 0;
+		for(int j = 0; j<run->tracks; j++)
+		{
+			int heat = i*run->tracks + j;
+			c.fitness += score(run, run->results[heat]);
+			c.finished += run->results[heat].status == ZR_FINISHED;
+			steps += run->steps[heat];
+		}
+	}
+	return steps;
+}
+
+static bool by_fitness(const candidate& a, const candidate& b)
+{
+	return a.fitness > b.fitness;
+}
+
+// The next generation out of a ranked population.
+static vector<candidate> breed(const vector<candidate>& ranked, random_source& chance)
+{
+	int size = ranked.size(), elite = max(size/4, 1);
+	vector<candidate> next(ranked.begin(), ranked.begin() + elite);
+	while((int)next.size() < size)
+	{
+		// The better of two, twice.
+		int a = min(chance.below(size), chance.below(size));
+		int b = min(chance.below(size), chance.below(size));
+		candidate child;
+		for(int i = 0; i<GENES; i++)
+		{
+			bot_settings parent = ranked[chance.below(2) ? a : b].settings;
+			allele(child.settings, i) = allele(parent, i);
+		}
+		mutate(child.settings, chance);
+		child.fitness = -1;
+		child.finished = 0;
+		next.push_back(child);
+	}
+	return next;
+}
+
+// The things a checkpoint has to agree on to be carried on from.
+static string describe(const evolution* run, int population, unsigned int seed)
+{
+	char line[256];
+	snprintf(line, sizeof(line), "%s tracks %d first %u generator %d length %d width %d laps %d population %d seed %u",
+			bot_tiers[run->tier].name, run->tracks, run->first_seed, run->config.generator,
+			run->config.race_length, run->config.race_width, run->config.laps, population, seed);
+	return line;
+}
+
+// Writes the population to a new file, then puts it in place of the old one.
+static bool save(const char* name, const string& description, int generation, const vector<candidate>& population)
+{
+	string temporary = string(name) + ".new";
+	FILE* file = fopen(temporary.c_str(), "w");
+	if(!file)
+		return false;
+	fprintf(file, "zracer-evolve\n%s\ngeneration %d\n", description.c_str(), generation);
+	for(unsigned i = 0; i<population.size(); i++)
+	{
+		const candidate& c = population[i];
+		const bot_settings& s = c.settings;
+		fprintf(file, "%d,%d,%d,%d,%d %.17g %d\n", s.range, s.accelerate, s.brake, s.swerve, s.reach,
+				c.fitness, c.finished);
+	}
+	bool written = !ferror(file);
+	written = !fclose(file) && written;
+	return written && !rename(temporary.c_str(), name);
+}
+
+// Reads the population back, if the file is there and is of the same run.
+static bool load(const char* name, const string& description, int* generation, vector<candidate>* population)
+{
+	FILE* file = fopen(name, "r");
+	if(!file)
+		return false;
+	char line[256];
+	bool same = fgets(line, sizeof(line), file) && !strcmp(line, "zracer-evolve\n") &&
+		fgets(line, sizeof(line), file) && line == description + "\n" &&
+		fscanf(file, "generation %d\n", generation) == 1;
+	for(unsigned i = 0; same && i<population->size(); i++)
+	{
+		candidate& c = (*population)[i];
+		bot_settings& s = c.settings;
+		same = fscanf(file, "%d,%d,%d,%d,%d %lg %d\n", &s.range, &s.accelerate, &s.brake, &s.swerve,
+				&s.reach, &c.fitness, &c.finished) == 7;
+	}
+	fclose(file);
+	if(!same)
+	{
+		fprintf(stderr, "zracer-evolve: %s is not a checkpoint of this run\n", name);
+		exit(1);
+	}
+	return true;
+}
+
+static void report(const evolution* run, int generation, long long steps, double elapsed)
+{
+	const candidate& best = run->population[0];
+	const bot_settings& s = best.settings;
+	double mean = 0;
+	for(unsigned i = 0; i<run->population.size(); i++)
+		mean += run->population[i].fitness;
+	mean /= run->population.size();
+	printf("generation %3d: best %.4f  mean %.4f  finished %2d/%d  %d,%d,%d,%d,%d", generation,
+			best.fitness/run->tracks, mean/run->tracks, best.finished, run->tracks,
+			s.range, s.accelerate, s.brake, s.swerve, s.reach);
+	if(steps)
+		printf("  %.0f steps/s", steps/elapsed);
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	int threads = sysconf(_SC_NPROCESSORS_ONLN), population = 32, generations = 20;
+	unsigned int seed = 1;
+	const char* checkpoint = NULL;
+	evolution run;
+	run.tracks = 16;
+	run.first_seed = 1;
+	zr_config_default(&run.config);
+	run.config.players = 1;
+	run.config.race_width = 80;
+
+	int option;
+	while((option = getopt(argc, argv, "j:n:s:g:l:w:p:e:r:c:")) != -1)
+		switch(option)
+		{
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			case 'n':
+				run.tracks = atoi(optarg);
+				break;
+			case 's':
+				run.first_seed = atoi(optarg);
+				break;
+			case 'g':
+				run.config.generator = atoi(optarg);
+				break;
+			case 'l':
+				run.config.race_length = atoi(optarg);
+				break;
+			case 'w':
+				run.config.race_width = atoi(optarg);
+				break;
+			case 'p':
+				population = atoi(optarg);
+				break;
+			case 'e':
+				generations = atoi(optarg);
+				break;
+			case 'r':
+				seed = atoi(optarg);
+				break;
+			case 'c':
+				checkpoint = optarg;
+				break;
+			default:
+				usage();
+		}
+	if(optind != argc-1 || run.tracks < 1 || population < 2)
+		usage();
+	for(run.tier = 0; run.tier<BOT_TIERS && strcmp(argv[optind], bot_tiers[run.tier].name); run.tier++);
+	if(run.tier == BOT_TIERS)
+		usage();
+	if(!resolve_config(&run.config))
+	{
+		fprintf(stderr, "zracer-evolve: these settings don't make a track\n");
+		return 1;
+	}
+
+	/*
+	 * The tier as it is, some of its mutants, and the rest anywhere in
+	 * bounds, so the search isn't stuck around where it started.
+	 */
+	string description = describe(&run, population, seed);
+	int generation = 0;
+	run.population.resize(population);
+	work_pool pool(threads);
+	if(!checkpoint || !load(checkpoint, description, &generation, &run.population))
+	{
+		random_source chance(seed);
+		for(int i = 0; i<population; i++)
+		{
+			candidate& c = run.population[i];
+			c.settings = bot_tiers[run.tier].settings;
+			if(i >= population/2)
+				for(int j = 0; j<GENES; j++)
+					allele(c.settings, j) = genes[j].least + chance.below(genes[j].most-genes[j].least+1);
+			else if(i)
+				mutate(c.settings, chance);
+			c.fitness = -1;
+		}
+		evaluate(&run, &pool);
+		stable_sort(run.population.begin(), run.population.end(), by_fitness);
+		if(checkpoint && !save(checkpoint, description, generation, run.population))
+			fprintf(stderr, "zracer-evolve: couldn't save %s\n", checkpoint);
+	}
+	report(&run, generation, 0, 0);
+
+	while(generation < generations)
+	{
+		generation++;
+		// A generation's own random numbers, so a run carried on from a checkpoint goes the same.
+		random_source chance(seed*1000003U + generation);
+		run.population = breed(run.population, chance);
+
+		timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		long long steps = evaluate(&run, &pool);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		// Stable, so the elite stays ahead of its equals.
+		stable_sort(run.population.begin(), run.population.end(), by_fitness);
+
+		if(checkpoint && !save(checkpoint, description, generation, run.population))
+			fprintf(stderr, "zracer-evolve: couldn't save %s\n", checkpoint);
+		report(&run, generation, steps, (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9);
+	}
+
+	const bot_settings& best = run.population[0].settings;
+	printf("%s: %d,%d,%d,%d,%d\n", bot_tiers[run.tier].name, best.range, best.accelerate,
+			best.brake, best.swerve, best.reach);
+	return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * zracer-heatmap - where the bots drive on a track
+ *
+ * Runs any number of headless races on the track of the seed, the cars
+ * of each driven by the bots given in turn, every bot's settings shaken
+ * up a little for every car so they don't all take the same way. The
+ * races run on a pool of threads, each counting the cells the cars take
+ * into a heatmap shard of its own. The summed up counts are printed over
+ * the track, row by row, and can be saved as numbers too. The shaking
+ * comes from the race's number, so the counts are the same whatever the
+ * number of threads.
+ */
+
+#include "engine.h"
+#include "bot.h"
+#include "heatmap.h"
+#include "pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+// The heat of a cell, from the least to the most visits.
+static const char shades[] = ".:-=+*#%@";
+
+struct survey
+{
+	zr_config config;
+	unsigned int seed;
+	vector<bot_settings> bots;
+	heatmap* counts;
+	bool counting;
+	// Per race.
+	vector<int> steps, finished;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: zracer-heatmap [-j THREADS] [-n RACES] [-p PLAYERS] [-s SEED] [-g GENERATOR]\n"
+			"                      [-l LENGTH] [-w WIDTH] [-o COUNTS] [-t] BOT...\n"
+			"A bot is a tier (");
+	for(int i = 0; i<BOT_TIERS; i++)
+		fprintf(stderr, i ? ", %s" : "%s", bot_tiers[i].name);
+	fprintf(stderr, ") or settings as RANGE,ACCELERATE,BRAKE,SWERVE,REACH.\n"
+			"-t only times the races, counting nothing.\n");
+	exit(1);
+}
+
+// Moves a setting by up to a quarter of it either way.
+static int shake(int value, random_source& chance)
+{
+	int most = value/4;
+	return max(0, value + chance.below(2*most+1) - most);
+}
+
+static void run_race(void* argument, int index, int thread)
+{
+	survey* run = static_cast<survey*>(argument);
+	const int players = run->config.players;
+	race contest(&run->config, run->seed);
+
+	random_source chance(index);
+	vector<steering_bot> drivers;
+	vector<bot*> seats;
+	for(int i = 0; i<players; i++)
+	{
+		bot_settings s = run->bots[(index*players + i)%run->bots.size()];
+		s.range = max(1, shake(s.range, chance));
+		s.accelerate = shake(s.accelerate, chance);
+		s.brake = shake(s.brake, chance);
+		s.swerve = shake(s.swerve, chance);
+		s.reach = shake(s.reach, chance);
+		drivers.push_back(steering_bot(s));
+	}
+	for(int i = 0; i<players; i++)
+		seats.push_back(&drivers[i]);
+
+	int limit = STEPS_PER_LINE*run->config.race_length*run->config.laps, steps = 0;
+	bool going;
+	do
+	{
+		drive_bots(&contest, &seats[0]);
+		going = contest.step();
+		steps++;
+		if(run->counting)
+			for(int i = 0; i<players; i++)
+				run->counts->visit(thread, &contest, i);
+	}
+	while(going && steps < limit);
+
+	run->steps[index] = steps;
+	run->finished[index] = 0;
+	for(int i = 0; i<players; i++)
+		run->finished[index] += contest.get_car(i).status == ZR_FINISHED;
+}
+
+// The counts, a line of numbers per row of the track.
+static bool save(heatmap* counts, const char* name)
+{
+	FILE* file = fopen(name, "w");
+	if(!file)
+		return false;
+	fprintf(file, "%d %d\n", counts->get_length(), counts->get_width());
+	for(int i = 0; i<counts->get_length(); i++)
+	{
+		const unsigned int* row = counts->get_row(i);
+		for(int j = 0; j<counts->get_width(); j++)
+			fprintf(file, j ? " %u" : "%u", row[j]);
+		fprintf(file, "\n");
+	}
+	return fclose(file) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	int threads = sysconf(_SC_NPROCESSORS_ONLN), races = 1000;
+	const char* saved = NULL;
+	survey run;
+	run.seed = 1;
+	run.counting = true;
+	zr_config_default(&run.config);
+	run.config.players = 4;
+	run.config.race_width = 80;
+
+	int option;
+	while((option = getopt(argc, argv, "j:n:p:s:g:l:w:o:t")) != -1)
+		switch(option)
+		{
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			case 'n':
+				races = atoi(optarg);
+				break;
+			case 'p':
+				run.config.players = atoi(optarg);
+				break;
+			case 's':
+				run.seed = atoi(optarg);
+				break;
+			case 'g':
+				run.config.generator = atoi(optarg);
+				break;
+			case 'l':
+				run.config.race_length = atoi(optarg);
+				break;
+			case 'w':
+				run.config.race_width = atoi(optarg);
+				break;
+			case 'o':
+				saved = optarg;
+				break;
+			case 't':
+				run.counting = false;
+				break;
+			default:
+				usage();
+		}
+	if(optind == argc || races < 1)
+		usage();
+	if(!resolve_config(&run.config))
+	{
+		fprintf(stderr, "zracer-heatmap: these settings don't make a track\n");
+		return 1;
+	}
+	for(int i = optind; i<argc; i++)
+	{
+		bot_settings s;
+		char rest;
+		int tier = 0;
+		while(tier < BOT_TIERS && strcmp(argv[i], bot_tiers[tier].name))
+			tier++;
+		if(tier < BOT_TIERS)
+			s = bot_tiers[tier].settings;
+		else if(sscanf(argv[i], "%d,%d,%d,%d,%d%c", &s.range, &s.accelerate, &s.brake,
+					&s.swerve, &s.reach, &rest) != 5)
+			usage();
+		run.bots.push_back(s);
+	}
+
+	// The track every race goes on, all the cars on the same one.
+	race first(&run.config, run.seed);
+	track* course = first.get_course(0);
+	work_pool pool(threads);
+	heatmap counts(course->get_length(), course->get_width(), pool.get_threads());
+	run.counts = &counts;
+	run.steps.assign(races, 0);
+	run.finished.assign(races, 0);
+
+	timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pool.run(run_race, &run, races);
+	counts.merge();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	// The shades go by the logarithm of the visits, there are a lot more of them on the racing line.
+	if(run.counting)
+	{
+		double most = log((double)max(counts.get_most(), 2U));
+		for(int i = 0; i<course->get_length(); i++)
+		{
+			const char* row = course->get_row(i);
+			const unsigned int* visits = counts.get_row(i);
+			for(int j = 0; j<course->get_width(); j++)
+				putchar(visits[j] ? shades[(int)((sizeof(shades)-2)*log((double)visits[j])/most + 0.5)] : row[j]);
+			putchar('\n');
+		}
+		if(saved && !save(&counts, saved))
+		{
+			fprintf(stderr, "zracer-heatmap: couldn't save %s\n", saved);
+			return 1;
+		}
+	}
+
+	long long steps = 0;
+	int finished = 0;
+	for(int i = 0; i<races; i++)
+	{
+		steps += run.steps[i];
+		finished += run.finished[i];
+	}
+	double elapsed = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9;
+	fprintf(stderr, "%d races, %d of %d cars finished, %lld steps on %d threads in %.3f s: %.0f steps/s\n",
+			races, finished, races*run.config.players, steps, pool.get_threads(), elapsed, steps/elapsed);
+	return 0;
+}
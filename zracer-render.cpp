@@ -0,0 +1,240 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * zracer-render - draws races and tracks without a terminal
+ *
+ * Uses the same drawing code as the game, only into a framebuffer, so
+ * its frames are what a player would see. Good for golden tests (diff
+ * the frames), thumbnails of many tracks at once and for timing the
+ * rendering without any tty in the way. Replays recorded by the game
+ * can be turned into asciinema casts, as fast as they render.
+ */
+
+#include "engine.h"
+#include "render.h"
+#include "cast.h"
+#include "replay.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+// Frame size used when none is given, a classic terminal.
+#define DEFAULT_HEIGHT 24
+#define DEFAULT_WIDTH 80
+// More lines or columns than any terminal a replay was recorded on has.
+#define MAX_SCREEN 4096
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: zracer-render frame SEED STEPS [HEIGHT WIDTH PLAYERS]\n"
+			"       zracer-render thumbnails FIRST_SEED COUNT [LENGTH WIDTH GENERATOR]\n"
+			"       zracer-render bench FRAMES [HEIGHT WIDTH PLAYERS THREADS]\n"
+			"       zracer-render cast REPLAY OUTPUT\n");
+	exit(1);
+}
+
+// Prints the characters of the frame, colors don't survive plain text.
+static void print_frame(FILE* output, framebuffer* frame)
+{
+	int height, width;
+	frame->get_size(height, width);
+
+	for(int i = 0; i<height; i++)
+	{
+		for(int j = 0; j<width; j++)
+			fputc(frame->at(i, j).character, output);
+		fputc('\n', output);
+	}
+}
+
+// An optional integer argument.
+static int argument(int argc, char** argv, int index, int fallback)
+{
+	return index < argc ? atoi(argv[index]) : fallback;
+}
+
+/*
+ * The race as the game would set it up on a terminal of the given size,
+ * with both players (if there are two) split vertically.
+ */
+static race* prepare(unsigned int seed, int height, int width, int players)
+{
+	zr_config config;
+	zr_config_default(&config);
+	config.players = players;
+	config.race_width = width/players;
+	config.view_height = height;
+	if(!resolve_config(&config))
+	{
+		fprintf(stderr, "zracer-render: these settings don't make a race\n");
+		exit(1);
+	}
+	return new race(&config, seed);
+}
+
+static void frame(int argc, char** argv)
+{
+	if(argc < 4)
+		usage();
+	int height = argument(argc, argv, 4, DEFAULT_HEIGHT);
+	int width = argument(argc, argv, 5, DEFAULT_WIDTH);
+	race* contest = prepare(atoi(argv[2]), height, width, argument(argc, argv, 6, 1));
+	framebuffer screen(height, width);
+
+	/*
+	 * Frames pile up the same way they do on the terminal, while
+	 * everybody just drives ahead, speeding up.
+	 */
+	display_race(&screen, contest, true, true);
+	for(int i = 0; i<atoi(argv[3]) && contest->step(); i++)
+	{
+		for(int j = 0; j<contest->get_cars(); j++)
+			contest->command(j, ACCELERATE, 0, contest->get_time());
+		display_race(&screen, contest, true, false);
+	}
+	print_frame(stdout, &screen);
+	delete contest;
+}
+
+static void thumbnails(int argc, char** argv)
+{
+	if(argc < 4)
+		usage();
+	zr_config config;
+	zr_config_default(&config);
+	config.race_length = argument(argc, argv, 4, config.race_length);
+	config.race_width = argument(argc, argv, 5, DEFAULT_WIDTH);
+	config.generator = argument(argc, argv, 6, config.generator);
+	if(!resolve_config(&config))
+	{
+		fprintf(stderr, "zracer-render: these settings don't make a track\n");
+		exit(1);
+	}
+
+	framebuffer screen(config.race_length, config.race_width);
+	for(int i = 0; i<atoi(argv[3]); i++)
+	{
+		unsigned int seed = atoi(argv[2]) + i;
+		random_source random(seed);
+		track course(&config, &random);
+		course.display(&screen, 0, 0);
+
+		char name[64];
+		sprintf(name, "track-%u.txt", seed);
+		FILE* output = fopen(name, "w");
+		if(!output)
+		{
+			perror(name);
+			exit(1);
+		}
+		print_frame(output, &screen);
+		fclose(output);
+	}
+}
+
+static void bench(int argc, char** argv)
+{
+	if(argc < 3)
+		usage();
+	int frames = atoi(argv[2]);
+	int height = argument(argc, argv, 3, DEFAULT_HEIGHT);
+	int width = argument(argc, argv, 4, DEFAULT_WIDTH);
+	int threads = argument(argc, argv, 6, 1);
+	race* contest = prepare(1, height, width, argument(argc, argv, 5, 1));
+	framebuffer screen(height, width);
+	compositor composer(threads);
+
+	// Full redraws, so every frame costs what the worst one in the game does.
+	timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(int i = 0; i<frames; i++)
+		composer.compose(&screen, contest, true, true);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double elapsed = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9;
+	printf("%d frames of %dx%d on %d threads in %.3f s, %.1f us per frame\n",
+			frames, height, width, threads, elapsed, elapsed*1e6/frames);
+	delete contest;
+}
+
+/*
+ * Plays the replay the way the game did, only without waiting between
+ * the steps, and records what the terminal would have shown.
+ */
+static void cast(int argc, char** argv)
+{
+	if(argc < 4)
+		usage();
+	replay_reader replay;
+	if(!replay.load(argv[2]))
+	{
+		fprintf(stderr, "zracer-render: %s isn't a replay of this version\n", argv[2]);
+		exit(1);
+	}
+	const replay_header& header = replay.get_header();
+	// A replay is only as good as the file, its settings are checked like anybody's.
+	zr_config config = header.config;
+	if(!resolve_config(&config))
+	{
+		fprintf(stderr, "zracer-render: the settings of %s don't make a race\n", argv[2]);
+		exit(1);
+	}
+	/*
+	 * And so is the screen, before anything is sized by it: the views
+	 * the way the game split it, as high as the race says they were and
+	 * a column at least for every player, and the minimap within it.
+	 */
+	int views_width = header.width - header.minimap_columns;
+	int view_height = header.vertical_split ? header.height : header.height/config.players;
+	if(header.width < 1 || MAX_SCREEN < header.width || header.height < 1 || MAX_SCREEN < header.height ||
+			header.minimap_columns < 0 || header.width <= header.minimap_columns ||
+			views_width < (header.vertical_split ? config.players : 1) ||
+			view_height != config.view_height)
+	{
+		fprintf(stderr, "zracer-render: the screen of %s doesn't fit its race\n", argv[2]);
+		exit(1);
+	}
+	race contest(&config, header.seed);
+	race_screen screen(&contest, header.height, header.width,
+			header.vertical_split, header.minimap_columns, 1);
+	framebuffer shown(header.height, header.width);
+	cast_recorder recorder(argv[3], header.height, header.width);
+	if(!recorder.is_open())
+	{
+		perror(argv[3]);
+		exit(1);
+	}
+
+	screen.draw(true);
+	bool racing;
+	do
+	{
+		replay.feed(&contest);
+		racing = contest.step() > 0;
+		screen.draw(false);
+		if(screen.get_frame()->flush(&shown, &recorder))
+			recorder.frame(contest.get_time()*header.delay/1e9);
+	}
+	while(racing);
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+		usage();
+	if(!strcmp(argv[1], "frame"))
+		frame(argc, argv);
+	else if(!strcmp(argv[1], "thumbnails"))
+		thumbnails(argc, argv);
+	else if(!strcmp(argv[1], "bench"))
+		bench(argc, argv);
+	else if(!strcmp(argv[1], "cast"))
+		cast(argc, argv);
+	else
+		usage();
+	return 0;
+}
@@ -0,0 +1,643 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * zracer-tournament - qualifying heats and a bracket for bots
+ *
+ * Every bot entrant drives a heat of its own on each of the generated
+ * tracks, and on the track of every replay given, or on each player's
+ * track when the players of the replay had different ones. The players
+ * of a replay have their recorded race for a heat, played back. A heat is
+ * a headless race, they're all run on a pool of threads, as many as
+ * there are cores unless told otherwise. On each track a bot is compared
+ * with the other bots, as they all raced the same ones, and the
+ * standings go by the share of them beaten. The players only raced the
+ * track they had in their replay, so they're told apart, compared with
+ * everybody on it.
+ *
+ * The bots then race a bracket seeded from the standings, two of them on
+ * a shared track at a time. A match is a few such duels on new tracks,
+ * whoever wins more goes on, the better seed on a draw. Every round the
+ * best one left meets the worst one, the best ones getting byes when the
+ * number isn't a power of two.
+ */
+
+#include "engine.h"
+#include "bot.h"
+#include "policy.h"
+#include "pool.h"
+#include "replay.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <unistd.h>
+
+struct entrant
+{
+	string name;
+	// A bot with the settings, a search bot, a policy's, or a player of the replay.
+	bool human, searching;
+	bot_settings settings;
+	search_settings lookahead;
+	int network, replay, car;
+	// The standings.
+	double score;
+	int heats, finished, best;
+};
+
+/*
+ * Where heats are raced: a generated track, or a replay's. On a replay
+ * of different tracks every player has a course of their own, the track
+ * of their car, the others are on the track all its players raced.
+ */
+struct course
+{
+	zr_config config;
+	unsigned int seed;
+	int replay, car;
+};
+
+struct heat
+{
+	int course, entrant;
+	zr_car result;
+	int steps;
+};
+
+// A duel of a match of the bracket: two entrants on a shared track.
+struct duel
+{
+	int first, second;
+	unsigned int seed;
+	// 0 or 1 for the one who won, -1 for a draw.
+	int winner, steps;
+};
+
+struct tournament
+{
+	// The generated tracks, and the first seed of the ones the bracket is raced on.
+	zr_config config;
+	unsigned int bracket_seed;
+	vector<entrant> entrants;
+	vector<course> courses;
+	vector<replay_reader> replays;
+	vector<policy> policies;
+	vector<heat> heats;
+	vector<duel> duels;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"usage: zracer-tournament [-j THREADS] [-n TRACKS] [-s FIRST_SEED] [-g GENERATOR]\n"
+			"                         [-l LENGTH] [-w WIDTH] [-m DUELS] [-b CARS] ENTRANT...\n"
+			"An entrant is a bot tier (");
+	for(int i = 0; i<BOT_TIERS; i++)
+		fprintf(stderr, i ? ", %s" : "%s", bot_tiers[i].name);
+	fprintf(stderr, "),\nbot settings as RANGE,ACCELERATE,BRAKE,SWERVE,REACH, a search bot (search,\n"
+			"or DEPTH,BEAM,RANGE), a policy or a replay.\n"
+			"-b only times the policies given, that many cars of each on the same track.\n");
+	exit(1);
+}
+
+// Makes an entrant out of an argument, or more of them out of a replay.
+static void enter(tournament* event, const char* argument)
+{
+	entrant e;
+	e.name = argument;
+	e.human = e.searching = false;
+	e.network = e.replay = e.car = -1;
+	e.score = 0;
+	e.heats = e.finished = 0;
+	e.best = INF;
+
+	for(int i = 0; i<BOT_TIERS; i++)
+		if(!strcmp(argument, bot_tiers[i].name))
+		{
+			e.settings = bot_tiers[i].settings;
+			event->entrants.push_back(e);
+			return;
+		}
+
+	e.lookahead = search_default;
+	if(!strcmp(argument, "search"))
+	{
+		e.searching = true;
+		event->entrants.push_back(e);
+		return;
+	}
+
+	bot_settings& s = e.settings;
+	search_settings& l = e.lookahead;
+	char rest;
+	if(sscanf(argument, "%d,%d,%d%c", &l.depth, &l.beam, &l.range, &rest) == 3)
+	{
+		if(l.depth < 1 || SEARCH_MAX_DEPTH < l.depth || l.beam < 1 || SEARCH_MAX_BEAM < l.beam || l.range < 0)
+		{
+			fprintf(stderr, "zracer-tournament: a search bot looks 1 to %d moves ahead, following 1 to %d ways,\n"
+					"with no less than 0 lines of range\n", SEARCH_MAX_DEPTH, SEARCH_MAX_BEAM);
+			exit(1);
+		}
+		e.searching = true;
+		event->entrants.push_back(e);
+		return;
+	}
+	if(sscanf(argument, "%d,%d,%d,%d,%d%c", &s.range, &s.accelerate, &s.brake,
+				&s.swerve, &s.reach, &rest) == 5)
+	{
+		event->entrants.push_back(e);
+		return;
+	}
+
+	policy brain;
+	if(brain.load(argument))
+	{
+		e.network = event->policies.size();
+		event->policies.push_back(brain);
+		event->entrants.push_back(e);
+		return;
+	}
+
+	replay_reader replay;
+	if(!replay.load(argument))
+	{
+		fprintf(stderr, "zracer-tournament: %s is neither a bot, a policy nor a replay of this version\n", argument);
+		exit(1);
+	}
+	const replay_header& header = replay.get_header();
+	course c;
+	c.config = header.config;
+	if(!resolve_config(&c.config))
+	{
+		fprintf(stderr, "zracer-tournament: the settings of %s don't make a race\n", argument);
+		exit(1);
+	}
+	c.seed = header.seed;
+	c.replay = event->replays.size();
+	c.car = -1;
+	if(c.config.players > 1 && !c.config.shared_track && !c.config.similar_track)
+		for(c.car = 0; c.car<c.config.players; c.car++)
+			event->courses.push_back(c);
+	else
+		event->courses.push_back(c);
+	event->replays.push_back(replay);
+
+	e.human = true;
+	e.replay = c.replay;
+	for(int i = 0; i<header.config.players; i++)
+	{
+		char name[16];
+		sprintf(name, "#%d", i+1);
+		e.name = string(argument) + name;
+		e.car = i;
+		event->entrants.push_back(e);
+	}
+}
+
+// The batches of cars a policy is timed over by -b.
+#define BENCH_BATCHES 2000
+
+/*
+ * Races entrants that aren't players, a car each in the order given,
+ * until everybody's done or it has gone on for too long, and retires
+ * whoever's left. A car given no entrant, less than zero, is retired
+ * before the start. The cars of a policy all go through one
+ * policy_driver, looked at and evaluated as a batch every step, the
+ * others are driven by their bots. Returns the steps taken.
+ */
+static int race_bots(tournament* event, race* contest, const int* entrants)
+{
+	const int cars = contest->get_cars();
+	const zr_config& config = contest->get_config();
+	vector<bot*> bots(cars, (bot*)NULL);
+	vector<policy_driver> batches;
+	vector<int> networks;
+	// A flag per car for every policy's driver, one driver after another.
+	bool* driven = new bool[cars*cars];
+	fill(driven, driven + cars*cars, false);
+	for(int i = 0; i<cars; i++)
+	{
+		if(entrants[i] < 0)
+		{
+			contest->retire(i);
+			continue;
+		}
+		const entrant& e = event->entrants[entrants[i]];
+		if(e.network < 0)
+		{
+			bots[i] = e.searching ? (bot*)new search_bot(e.lookahead) : new steering_bot(e.settings);
+			continue;
+		}
+		unsigned j = 0;
+		while(j < networks.size() && networks[j] != e.network)
+			j++;
+		if(j == networks.size())
+		{
+			networks.push_back(e.network);
+			batches.push_back(policy_driver(&event->policies[e.network]));
+		}
+		driven[j*cars + i] = true;
+	}
+
+	int limit = STEPS_PER_LINE*config.race_length*config.laps, steps = 0;
+	do
+	{
+		for(unsigned i = 0; i<batches.size(); i++)
+			batches[i].drive(contest, driven + i*cars);
+		drive_bots(contest, &bots[0]);
+		steps++;
+	}
+	while(contest->step() && steps < limit);
+	for(int i = 0; i<cars; i++)
+	{
+		contest->retire(i);
+		delete bots[i];
+	}
+	delete[] driven;
+	return steps;
+}
+
+// The race of a heat, until everybody's done or it has gone on for too long.
+static void run_heat(void* argument, int index, int)
+{
+	tournament* event = static_cast<tournament*>(argument);
+	heat& h = event->heats[index];
+	const course& place = event->courses[h.course];
+	const entrant& e = event->entrants[h.entrant];
+	zr_config config = place.config;
+	h.steps = 0;
+
+	if(e.human)
+	{
+		// Played back the way it was recorded.
+		replay_reader replay = event->replays[e.replay];
+		race contest(&config, place.seed);
+		do
+		{
+			replay.feed(&contest);
+			h.steps++;
+		}
+		while(contest.step());
+		h.result = contest.get_car(e.car);
+		return;
+	}
+
+	if(place.car < 0)
+	{
+		// Alone on the track, which comes out the same as the first player's of the replay.
+		config.players = 1;
+		config.shared_track = config.similar_track = 0;
+		race contest(&config, place.seed);
+		h.steps = race_bots(event, &contest, &h.entrant);
+		h.result = contest.get_car(0);
+		return;
+	}
+
+	// In the place of a player of a replay on different tracks, the others left out.
+	race contest(&config, place.seed);
+	vector<int> seats(config.players, -1);
+	seats[place.car] = h.entrant;
+	h.steps = race_bots(event, &contest, &seats[0]);
+	h.result = contest.get_car(place.car);
+}
+
+/*
+ * Which of two results on the same track is better, less than zero for
+ * the first one. Finishing beats not finishing, sooner is better, and
+ * out of the race it's how far a car got, and then how long it lasted.
+ */
+static int compare(const zr_car& a, const zr_car& b)
+{
+	bool finished_a = a.status == ZR_FINISHED, finished_b = b.status == ZR_FINISHED;
+	if(finished_a != finished_b)
+		return finished_a ? -1 : 1;
+	if(finished_a)
+		return a.finish_time - b.finish_time;
+	if(a.y != b.y)
+		return a.y - b.y;
+	return b.finish_time - a.finish_time;
+}
+
+static bool by_score(const entrant& a, const entrant& b)
+{
+	// The players after the bots, they have standings of their own.
+	if(a.human != b.human)
+		return b.human;
+	return a.score > b.score;
+}
+
+// Two bots on a shared track, until both are done or it has gone on for too long.
+static void run_duel(void* argument, int index, int)
+{
+	tournament* event = static_cast<tournament*>(argument);
+	duel& d = event->duels[index];
+	zr_config config = event->config;
+	config.players = 2;
+	config.shared_track = 1;
+	race contest(&config, d.seed);
+	int seats[2] = {d.first, d.second};
+	d.steps = race_bots(event, &contest, seats);
+	int order = compare(contest.get_car(0), contest.get_car(1));
+	d.winner = order < 0 ? 0 : order > 0 ? 1 : -1;
+}
+
+/*
+ * Races the bracket between the first bots, in the order of their
+ * seeds, printing every round. Returns the steps taken.
+ */
+static long long run_bracket(tournament* event, work_pool* pool, int bots, int duels)
+{
+	vector<int> left;
+	for(int i = 0; i<bots; i++)
+		left.push_back(i);
+	long long steps = 0;
+	unsigned int seed = event->bracket_seed;
+
+	for(int round = 1; left.size() > 1; round++)
+	{
+		int size = 1;
+		while(size < (int)left.size())
+			size *= 2;
+		int byes = size - left.size(), matches = (left.size() - byes)/2;
+
+		// The best one of those without a bye against the worst one, and so on.
+		event->duels.clear();
+		for(int i = 0; i<matches; i++)
+			for(int j = 0; j<duels; j++)
+			{
+				duel d;
+				d.first = left[byes+i];
+				d.second = left[left.size()-1-i];
+				d.seed = seed++;
+				event->duels.push_back(d);
+			}
+		pool->run(run_duel, event, event->duels.size());
+
+		printf("\nRound %d:\n", round);
+		vector<int> next(left.begin(), left.begin() + byes);
+		for(int i = 0; i<byes; i++)
+			printf("     %-24s bye\n", event->entrants[left[i]].name.c_str());
+		for(int i = 0; i<matches; i++)
+		{
+			int wins[2] = {0, 0};
+			for(int j = 0; j<duels; j++)
+			{
+				const duel& d = event->duels[i*duels + j];
+				if(d.winner >= 0)
+					wins[d.winner]++;
+				steps += d.steps;
+			}
+			int first = left[byes+i], second = left[left.size()-1-i];
+			// On a draw the better seed goes on.
+			int winner = wins[1] > wins[0] ? second : first, loser = winner == first ? second : first;
+			printf("     %-24s beats %-24s %d-%d\n", event->entrants[winner].name.c_str(),
+					event->entrants[loser].name.c_str(), max(wins[0], wins[1]), min(wins[0], wins[1]));
+			next.push_back(winner);
+		}
+		// Kept in the order of the seeds.
+		sort(next.begin(), next.end());
+		left.swap(next);
+	}
+	if(bots > 1)
+		printf("\nWinner: %s\n", event->entrants[left[0]].name.c_str());
+	return steps;
+}
+
+/*
+ * Times each policy driving the given number of cars, every step the
+ * ones due to move looked at and evaluated as one batch, the way they
+ * are in the heats and the bracket. The cars race the same track, each
+ * from the middle of the start the way a car alone does, so none starts
+ * off the road. The races go on from the first seed, a new one whenever
+ * the last is over, until the policy has driven BENCH_BATCHES batches.
+ * Returns the policies timed.
+ */
+static int bench(tournament* event, unsigned int seed, int cars)
+{
+	zr_config config = event->config;
+	config.players = cars;
+	config.shared_track = 0;
+	config.similar_track = 1;
+	if(!resolve_config(&config))
+		return -1;
+	bool* driven = new bool[cars];
+	fill(driven, driven+cars, true);
+	int limit = STEPS_PER_LINE*config.race_length*config.laps, timed = 0;
+
+	for(unsigned i = 0; i<event->entrants.size(); i++)
+	{
+		const entrant& e = event->entrants[i];
+		if(e.network < 0)
+			continue;
+		policy_driver driver(&event->policies[e.network]);
+		long long batches = 0, moves = 0;
+		int races = 0;
+		double elapsed = 0;
+		while(batches < BENCH_BATCHES)
+		{
+			race contest(&config, seed + races++);
+			int steps = 0;
+			do
+			{
+				int due = 0;
+				for(int j = 0; j<cars; j++)
+					due += contest.due(j);
+				timespec start, end;
+				clock_gettime(CLOCK_MONOTONIC, &start);
+				driver.drive(&contest, driven);
+				clock_gettime(CLOCK_MONOTONIC, &end);
+				if(due)
+				{
+					elapsed += (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9;
+					batches++;
+					moves += due;
+				}
+			}
+			while(contest.step() && ++steps < limit && batches < BENCH_BATCHES);
+		}
+
+		printf("%-24s %s: %lld batches of %.1f cars on average in %d races, %.2f us a batch, %.2f us a car\n",
+				e.name.c_str(), event->policies[e.network].get_kernel(), batches, (double)moves/batches,
+				races, elapsed*1e6/batches, elapsed*1e6/moves);
+		timed++;
+	}
+	delete[] driven;
+	return timed;
+}
+
+int main(int argc, char** argv)
+{
+	int threads = sysconf(_SC_NPROCESSORS_ONLN), tracks = 16, duels = 3, timed = 0;
+	unsigned int first_seed = 1;
+	zr_config config;
+	zr_config_default(&config);
+	config.players = 1;
+	config.race_width = 80;
+
+	int option;
+	while((option = getopt(argc, argv, "j:n:s:g:l:w:m:b:")) != -1)
+		switch(option)
+		{
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			case 'n':
+				tracks = atoi(optarg);
+				break;
+			case 's':
+				first_seed = atoi(optarg);
+				break;
+			case 'g':
+				config.generator = atoi(optarg);
+				break;
+			case 'l':
+				config.race_length = atoi(optarg);
+				break;
+			case 'w':
+				config.race_width = atoi(optarg);
+				break;
+			case 'm':
+				duels = atoi(optarg);
+				break;
+			case 'b':
+				timed = atoi(optarg);
+				if(timed < 1)
+					usage();
+				break;
+			default:
+				usage();
+		}
+	if(optind == argc || duels < 1)
+		usage();
+	if(!resolve_config(&config))
+	{
+		fprintf(stderr, "zracer-tournament: these settings don't make a track\n");
+		return 1;
+	}
+
+	tournament event;
+	event.config = config;
+	event.bracket_seed = first_seed + tracks;
+	for(int i = 0; i<tracks; i++)
+	{
+		course c;
+		c.config = config;
+		c.seed = first_seed + i;
+		c.replay = c.car = -1;
+		event.courses.push_back(c);
+	}
+	for(int i = optind; i<argc; i++)
+		enter(&event, argv[i]);
+	if(timed)
+	{
+		int policies = bench(&event, first_seed, timed);
+		if(policies < 0)
+			fprintf(stderr, "zracer-tournament: these settings don't make a race of %d cars\n", timed);
+		else if(!policies)
+			fprintf(stderr, "zracer-tournament: -b times policies, and none was given\n");
+		return policies <= 0;
+	}
+
+	// The bots everywhere, the players on the tracks they raced.
+	for(unsigned i = 0; i<event.entrants.size(); i++)
+	{
+		const entrant& e = event.entrants[i];
+		heat h;
+		h.entrant = i;
+		for(unsigned j = 0; j<event.courses.size(); j++)
+		{
+			const course& c = event.courses[j];
+			h.course = j;
+			if(!e.human || (c.replay == e.replay && (c.car < 0 || c.car == e.car)))
+				event.heats.push_back(h);
+		}
+	}
+
+	work_pool pool(threads);
+	timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pool.run(run_heat, &event, event.heats.size());
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9;
+
+	/*
+	 * On each track a bot against the other bots, which raced them all,
+	 * and a player against everybody that raced the replay's one.
+	 */
+	vector<vector<int> > raced(event.courses.size());
+	for(unsigned i = 0; i<event.heats.size(); i++)
+		raced[event.heats[i].course].push_back(i);
+	long long steps = 0;
+	for(unsigned i = 0; i<event.heats.size(); i++)
+	{
+		const heat& h = event.heats[i];
+		const vector<int>& rivals = raced[h.course];
+		entrant& e = event.entrants[h.entrant];
+		double beaten = 0;
+		int compared = 0;
+		for(unsigned j = 0; j<rivals.size(); j++)
+		{
+			const heat& rival = event.heats[rivals[j]];
+			if(rivals[j] == (int)i || (!e.human && event.entrants[rival.entrant].human))
+				continue;
+			int order = compare(h.result, rival.result);
+			beaten += order < 0 ? 1 : order == 0 ? 0.5 : 0;
+			compared++;
+		}
+		e.score += compared ? beaten/compared : 1;
+		e.heats++;
+		if(h.result.status == ZR_FINISHED)
+		{
+			e.finished++;
+			e.best = min(e.best, h.result.finish_time);
+		}
+		steps += h.steps;
+	}
+	int bots = 0;
+	for(unsigned i = 0; i<event.entrants.size(); i++)
+	{
+		event.entrants[i].score /= max(event.entrants[i].heats, 1);
+		bots += !event.entrants[i].human;
+	}
+	// Stable, so equal ones stay in the order they were entered.
+	stable_sort(event.entrants.begin(), event.entrants.end(), by_score);
+
+	if(bots)
+		printf("Standings of the bots after a heat on each of %d tracks:\n", (int)event.courses.size());
+	for(int i = 0; i<bots; i++)
+	{
+		const entrant& e = event.entrants[i];
+		printf("%3d. %-24s score %.3f  heats %3d  finished %3d", i+1, e.name.c_str(),
+				e.score, e.heats, e.finished);
+		if(e.finished)
+			printf("  best %d", e.best);
+		printf("\n");
+	}
+	if(bots < (int)event.entrants.size())
+		printf("%sPlayers, each against everybody on the track they raced:\n", bots ? "\n" : "");
+	for(unsigned i = bots; i<event.entrants.size(); i++)
+	{
+		const entrant& e = event.entrants[i];
+		printf("     %-24s score %.3f  %s", e.name.c_str(), e.score, e.finished ? "finished" : "didn't finish");
+		if(e.finished)
+			printf(" in %d", e.best);
+		printf("\n");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	long long bracket_steps = run_bracket(&event, &pool, bots, duels);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double bracket_elapsed = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9;
+
+	printf("\n%d heats, %lld steps on %d threads in %.3f s: %.1f heats/s, %.0f steps/s\n",
+			(int)event.heats.size(), steps, pool.get_threads(), elapsed,
+			event.heats.size()/elapsed, steps/elapsed);
+	if(bots > 1)
+		printf("The bracket, %lld steps in %.3f s: %.0f steps/s\n", bracket_steps, bracket_elapsed,
+				bracket_steps/bracket_elapsed);
+	return 0;
+}
@@ -8,15 +8,22 @@
  * ZRacer is a racing game where 1 - 2 players race on a randomly
  * generated racecourse with split-screen and using the same keyboard.
  * 
+ * The simulation itself lives in libzracer (engine.cpp), this file is
+ * just the curses front end: menus, settings editor, key handling and
+ * split-screen display.
+ *
  * Conventions taken:
  * 	- coordinates order is (y, x)
  * 	- (0, 0) is upper left corner of everything
  * 	- as a result, finish line is at line 0
- * 	- car doesn't take up the whole rectangle (for collision checking)
  * 	- when a car crashes, it's window is frozen and no input is taken
- * 	- the track is stored as its ascii-art representation
  */
 
+#include "engine.h"
+#include "render.h"
+#include "cast.h"
+#include "replay.h"
+#include "input.h"
 #include <curses.h>
 #include <cstdarg>
 #include <cstdio>
@@ -26,30 +33,16 @@
 #include <ctime>
 #include <cassert>
 #include <cstdlib>
+#include <unistd.h>
 
 using namespace std;
 
-// This one defines a random function with results in range 0..1 (double).
-#define drand()((double)rand()/RAND_MAX)
-
 // Various constants
-#define MAX_CAR_SIZE 20
 #define MAX_PLAYERS 2
-#define INF 123456789
 #define KEY_ESC 27 // Missing in ncurses...
 #define RESULTS_COLORS 11
 #define MESSAGE_LENGTH 100
 
-// Action values
-#define ACCELERATE -1
-#define BRAKE 1
-#define LEFT -1
-#define RIGHT 1
-
-// Make passage, but don't exceed available space.
-#define MINIMAL_WIDTH\
-	(min(settings.players*settings.car_size*2.5, (double)settings.race_width-2))
-
 // Main menu item defines, for convenience.
 #define MENU_QUIT 0
 #define MENU_START 1
@@ -58,55 +51,39 @@ using namespace std;
 /*
  * In-game settings. This needn't really by a struct, but it looks more
  * readable to access settings by "settings.delay" than "delay".
+ * Everything the simulation needs is inherited from zr_config, here are
+ * only the things specific to the terminal game.
  */
 
-struct _settings
+struct _settings : zr_config
 {
 	// Basic game delay, is not equal to move time, but is a factor.
 	timespec delay;
 	// The axis of splitscreen.
 	bool vertical_split;
-	// Whether both players race on the same-looking racecourse.
-	bool similar_track;
-	// Or maybe literally the same one? (Collisions possible)
-	bool shared_track;
-	// The sizes of the course, better make it bigger than the car ;)
-	int race_length, race_width;
-	// The minimal width of the road the players can drive.
-	int minimal_width;
-	// The number of participants.
-	int players;
-	// Character with which the cars are drawn.
-	char character;
-	// The size of the car.
-	int car_size;
-	// The distance interval at which the speed of the car changes.
-	int speed_base;
-	// The chance of generating a rock on a given line
-	double rock_chance;
-	// The chance of generating a turning on a given line
-	double turn_chance;
 	// Keys players use to interact with the game.
 	int controls[MAX_PLAYERS][4];
+	// How long (ms) an ESC waits for the rest of a key sequence.
+	int escape_delay;
+	// Whether to show the whole race next to the players' views.
+	bool minimap;
+	// Where to record the races, as casts and as replays, if at all.
+	const char* cast_file;
+	const char* replay_file;
 
 	void reset(void)
 	{
+		zr_config_default(this);
+
 		delay.tv_sec = 0;
 		// Hundredth of a second * const.
 		delay.tv_nsec = 1000000*25;
-		similar_track = vertical_split = true;
-		shared_track = true;
-		race_length = 500;
-		// Zero makes these 2 variables adjusted to screen size.
-		race_width = 0;
-		minimal_width = 0;
-		players = 1;
-		character = '^';
-		car_size = 10;
-		speed_base = 5;
-		rock_chance = 0.025;
-		turn_chance = 0.125;
-		
+		vertical_split = true;
+		// Plenty for a local terminal and most remote ones.
+		escape_delay = 20;
+		minimap = true;
+		cast_file = replay_file = NULL;
+
 		// Arrow keys for first player
 		controls[0][0]=KEY_UP;
 		controls[0][1]=KEY_DOWN;
@@ -127,149 +104,90 @@ struct _settings
 	void _edit_turns(void);
 	void _edit_delay(void);
 	void _edit_sharing(void);
+	void _edit_escape(void);
+	void _edit_policy(void);
+	void _edit_minimap(void);
+	void _edit_generator(void);
+	void _edit_laps(void);
 } settings;
 
-class car_image
-{
-	/*
-	 * This is where we store the image of the car.
-	 * For performance purposes, it is created only once when scaled.
-	 */
-	bool storage [MAX_CAR_SIZE+1][MAX_CAR_SIZE+1];
-	// And as list of used pixels coords.
-	vector<pair<int, int> > dots;
-	char character;
-	int color, size;
-
-	/*
-	 * Internal functions. First one is _clear() - it just sets all
-	 * the storage area to false. Second one is line() - takes coords
-	 * of 2 points and draws a line between them (or more literally
-	 * just marks certain values within storage as true).
-	 */
-	void _clear(void);
-	void _line(int, int, int, int);
-	
-	public:
-	/*
-	 * Constructor, takes input from the settings.
-	 */
-	car_image(void);
-	/*
-	 * This one simply draws the car on the given window. It assumes 
-	 * that this can clearly be done, so all the checks need to be
-	 * done earlier. The parameters it takes are the window and position
-	 * of upper left corner of the car.
-	 */
-	void display(WINDOW*, int, int);
-	/*
-	 * Draws the explosion of the car. Parameters are windows, position
-	 * of upper left corner of the car. Position is relative to the window, 
-	 * _not_ the track.
-	 */
-	void explode(WINDOW*, int, int);
-	/*
-	 * Collision happens only when an obstacle is on a pace taken by the
-	 * car. It is possible to have the obstacle between the car's "ribs".
-	 * This checks whether given pace relative to *car's position* is
-	 * taken by the car.
-	 */
-	bool collision_check(int, int);
-	/*
-	 * These are simple mutators.
-	 */
-	void set_character(char);
-	void set_color(int);
-	
-	// And a simple accessor.
-	vector<pair<int, int> > get_dots(void);
-};
+/*
+ * During the race the keys are read past curses, so that arrows don't
+ * wait for ESCDELAY and ESC doesn't wait at all.
+ */
+key_decoder keyboard(STDIN_FILENO, 0);
 
-class track
+/*
+ * The engine draws on canvases, this one puts the characters into a curses
+ * window.
+ */
+class window_canvas : public canvas
 {
-	/*
-	 * These are the most important data for the game. The track should
-	 * be generated only once each game, preferably shared between players.
-	 */
-	vector<vector<char> > circuit;
+	WINDOW* screen;
 
 	public:
-	/*
-	 * Two constructors. One takes input from the settings, second just 
-	 * copies another track.
-	 */
-	track(void);
-	track(track*);
-	/*
-	 * Takes the number of the top line to display and the window.
-	 * Window's height and width are grabbed by getmaxyx().
-	 * There's an assertion that the window is wide enough.
-	 */
-	void display(WINDOW*, int);
-	/*
-	 * Tells whether there's an obstacle at a given pace.
-	 */
-	bool taken(int, int);
-
-	void mark(int, int, car_image*);
-	void unmark(int, int, car_image*);
+	window_canvas(WINDOW*);
+	void get_size(int&, int&);
+	void put(int, int, char, int, bool);
 };
 
 class player_handler
 {
-	WINDOW* screen;
-	track* course;
-	car_image* car;
-	// last_move is the time value of the previous player's action
-	// (y, x) is the position of the upper left corner of the car
-	// top_line is the top displayed line of the course
-	// commands store what player clicked
-	int last_move, y, x, top_line, command_x, command_y, screen_height;
+	// The race is owned by the game, the player only watches its own car.
+	race* contest;
+	// So is the replay being recorded, if any.
+	replay_writer* recording;
+	int index;
 	int controls[4];
 
+	// Queues a command, and records it.
+	void _command(int, int, long long);
+
 	public:
 	/*
-	 * This constructor prepares the part of the screen for the player.
-	 * It decides which part of screen to take, and the color of the car,
-	 * taking the settings and the player number. The track is generated
-	 * outside it.
-	 */
-	player_handler(int, track*);
-	/*
-	 * Player's main loop. Returns true if the player continues to play,
-	 * and false if the game ends for him. Also does redraw the window.
+	 * This constructor takes the player's controls from the settings.
+	 * The race is created outside it, the game draws it and records it.
 	 */
-	bool tick(int);
+	player_handler(int, race*, replay_writer*);
 	/*
 	 * Knowing the player's key controls, this one does what it's named for.
-	 * Only sets the action to perform during next move.
+	 * Only queues the action to perform during next move, with the time
+	 * the key was read at.
 	 */
-	void parse_input(int);
-	/*
-	 * These are used only in shared track races in order to catch player-player
-	 * collisions.
-	 */
-	void mark_position(void);
-	void unmark_position(void);
-	/*
-	 * Apart from deallocating standard structures, this one has also to
-	 * destroy the ncurses window it created, so it needs a separate destructor.
-	 */
-	//~player_handler(void);
+	void parse_input(int, long long);
 };
 
 class game
 {
-	int time;
+	race* contest;
 	player_handler* players[MAX_PLAYERS];
-	bool alive[MAX_PLAYERS];
-	
+	/*
+	 * The players' views are composed on the screen, in parallel, then
+	 * only the cells that differ from what's shown go to the terminal.
+	 */
+	race_screen* screen;
+	framebuffer* shown;
+	window_canvas* terminal;
+	/*
+	 * What goes to the terminal goes to the cast as well, when recording.
+	 * The replay gets the keys.
+	 */
+	cast_recorder* recorder;
+	tee_canvas* output;
+	replay_writer* recording;
+	long long start;
+	// When the next tick is due.
+	long long next_tick;
+
+	// Passes all the keys waiting to the players.
+	void _input(void);
+
 	public:
 		/*
-		 * Constructor does all the fancy things like initializing ncurses,
-		 * while destructor brings back normal tty behaviour. This is great,
-		 * as it doesn't force me to remember about deinitialization any
-		 * time I want to break the game.
+		 * Constructor does all the fancy things like switching the terminal
+		 * to racing and preparing the windows, while destructor cleans them
+		 * up. This is great, as it doesn't force me to remember about
+		 * deinitialization any time I want to break the game.
 		 */
 		game(void);
 		~game(void);
@@ -278,17 +196,119 @@ class game
 		 * It returns true as long as game continues.
 		 */
 		bool tick(void);
+		/*
+		 * Waits for the next tick. Keys pressed meanwhile are handed to
+		 * the players as they come, so their timing isn't lost.
+		 */
+		void wait(void);
+};
+
+/*
+ * This class is created solely for the cool trick used in main(): the
+ * constructor brings up curses, the destructor brings back normal tty
+ * behaviour, whichever way the program ends. There is only one for the
+ * whole run, so the terminal is set up once and the screens just switch
+ * the input modes they need.
+ * It's struct just because it doesn't have anything private.
+ */
+struct simple_curses
+{
+	simple_curses(void)
+	{
+		initscr();
+		/*
+		 * Until a session has been left with endwin() once, ncurses
+		 * flushes its output at every cursor move, a write per line
+		 * of a screen. Leaving and coming back with refresh(), before
+		 * anything is drawn, gets the buffered updates for the run.
+		 */
+		endwin();
+		refresh();
+		// Keys one at a time and not echoed, until a screen sets the modes it
+		// needs. The keypad stays off, the race decodes the sequences itself.
+		cbreak();
+		noecho();
+		keypad(stdscr, false);
+		// Colors are needed only for the race, it checks them itself.
+		if(has_colors())
+		{
+			start_color();
+			// Color palette.
+			init_pair(COLOR_BLACK, COLOR_BLACK, COLOR_BLACK);
+			init_pair(COLOR_RED, COLOR_RED, COLOR_BLACK);
+			init_pair(COLOR_GREEN, COLOR_GREEN, COLOR_BLACK);
+			init_pair(COLOR_YELLOW, COLOR_YELLOW, COLOR_BLACK);
+			init_pair(COLOR_BLUE, COLOR_BLUE, COLOR_BLACK);
+			init_pair(COLOR_MAGENTA, COLOR_MAGENTA, COLOR_BLACK);
+			init_pair(COLOR_CYAN, COLOR_CYAN, COLOR_BLACK);
+			init_pair(COLOR_WHITE, COLOR_WHITE, COLOR_BLACK);
+			init_pair(RESULTS_COLORS, COLOR_YELLOW, COLOR_BLUE);
+		}
+	}
+
+	~simple_curses(void)
+	{
+		endwin();
+	}
+
+	/*
+	 * Menus and the editor: keys come one at a time, but scanw() needs
+	 * to see what is typed and to wait for it.
+	 */
+	static void menu_mode(void)
+	{
+		typeahead(STDIN_FILENO);
+		nodelay(stdscr, false);
+		cbreak();
+		echo();
+		nl();
+		clear();
+	}
+
+	/*
+	 * The race: nothing echoed and nothing waits, the game loop polls
+	 * the keyboard every tick. Curses mustn't look at the input then,
+	 * not even to postpone the refreshes when keys are pending.
+	 */
+	static void race_mode(void)
+	{
+		cbreak();
+		noecho();
+		nonl();
+		nodelay(stdscr, true);
+		typeahead(-1);
+		flushinp();
+		keyboard.flush();
+		keyboard.set_timeout(settings.escape_delay);
+	}
 };
 
 int main_menu (void);
 // This is a wrapper around printw, also accepts arbitrary number of arguments
-void message (char*, ...);
+void message (const char*, ...);
 
-int main (void)
+int main (int argc, char** argv)
 {
 	bool keep_asking = true;
 
 	settings.reset();
+	int option;
+	while((option = getopt(argc, argv, "c:r:")) != -1)
+		switch(option)
+		{
+			case 'c':
+				settings.cast_file = optarg;
+				break;
+			case 'r':
+				settings.replay_file = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-c CAST] [-r REPLAY]\n", argv[0]);
+				return 1;
+		}
+
+	// The one curses session, up until main() returns.
+	simple_curses enviroment;
 	
 	while(keep_asking)
 	{
@@ -298,7 +318,7 @@ int main (void)
 				{
 					game race;
 					while(race.tick())
-						nanosleep(&settings.delay, NULL);
+						race.wait();
 					break;
 				}
 			case MENU_OPTIONS:
@@ -317,7 +337,7 @@ int main (void)
  * running. Good for displaying error messages, final results and so. Waits for an
  * ESC pressed before quiting.
  */
-void message (char* format_string, ...)
+void message (const char* format_string, ...)
 {
 	va_list args;
 	// Allocate a buffer for the message.
@@ -348,42 +368,16 @@ void message (char* format_string, ...)
 	wrefresh(message_win);
 	
 	// Wait for an ESC.
-	while(getch()!=KEY_ESC)
-		nanosleep(&settings.delay, NULL);
+	while(keyboard.get_key()!=KEY_ESC)
+		keyboard.wait(settings.delay.tv_sec*1000000000LL + settings.delay.tv_nsec);
 
 	// Clean up after myself.
 	delwin(message_win);
 }
 
-/*
- * This class is created solely for the cool trick used in game constructor/destructor.
- * It's struct just because it doesn't have anything private.
- * Watch it's ingenuity and simplicity!
- */
-struct simple_curses
-{
-	simple_curses(void)
-	{
-		// Initialize ncurses. This is done separately from initializing for
-		// the game in order to have different options. 
-		initscr();
-		cbreak();
-		clear();
-	}
-
-	~simple_curses(void)
-	{
-		// Fall back to normal options
-		nocbreak();
-		endwin();
-	}
-};
-
 int main_menu (void)
 {
-	// Whole trick is: constructor get's run here, destructor whenever leaving
-	// the function.
-	simple_curses enviroment;
+	simple_curses::menu_mode();
 
 	// Tell them what to do...
 	printw("\t\tWelcome to ZRacer by lRem!\n");
@@ -417,7 +411,7 @@ int main_menu (void)
 
 void _settings::editor(void)
 {
-	simple_curses enviroment;
+	simple_curses::menu_mode();
 
 	printw("\t\tSETTINGS EDITOR\n");
 	printw("q) Quit the editor\n");
@@ -427,8 +421,12 @@ void _settings::editor(void)
 	printw("t) Set the chance to generate a turning\n");
 	printw("s) Set master delay\n");
 	printw("h) Set track sharing\n");
-	// This doesn't give nice results...
-	//printw("w) Set the width of the racecourse\n");
+	printw("e) Set the ESC key timeout\n");
+	printw("c) Set what several keys between two moves do\n");
+	printw("w) Set the width of the racecourse\n");
+	printw("m) Show or hide the minimap\n");
+	printw("g) Choose how the tracks are generated\n");
+	printw("a) Set the number of laps\n");
 	char pressed = 0;
 	for(;;)
 	{
@@ -456,9 +454,25 @@ void _settings::editor(void)
 				break;
 			case 'h':
 				_edit_sharing();
-			//case 'w':
-			//	_edit_width();
-			//	break;
+				break;
+			case 'e':
+				_edit_escape();
+				break;
+			case 'c':
+				_edit_policy();
+				break;
+			case 'w':
+				_edit_width();
+				break;
+			case 'm':
+				_edit_minimap();
+				break;
+			case 'g':
+				_edit_generator();
+				break;
+			case 'a':
+				_edit_laps();
+				break;
 		}
 	}
 	
@@ -490,7 +504,7 @@ void _settings::_edit_length(void)
 
 void _settings::_edit_width(void)
 {
-	printw("\n\tSet the width of the track (narrower than terminal, 0 means max, currently %d):", race_width);
+	printw("\n\tSet the width of the track (0 fits the screen, wider ones scroll, currently %d):", race_width);
 	race_width = -1;
 	// While players outside the possible range.
 	for(; race_width<0;)
@@ -521,11 +535,11 @@ void _settings::_edit_turns(void)
 
 void _settings::_edit_delay(void)
 {
-	printw("\n\tSet the master delay (positive, nanosceonds, currently %d):", delay.tv_nsec);
+	printw("\n\tSet the master delay (positive, nanosceonds, currently %ld):", delay.tv_nsec);
 	delay.tv_nsec = -1;
 	for(; delay.tv_nsec<0;)
 	{
-		scanw("%d", &delay.tv_nsec);
+		scanw("%ld", &delay.tv_nsec);
 	}
 }
 
@@ -554,476 +568,299 @@ void _settings::_edit_sharing(void)
 	}
 }
 
-bool game::tick(void)
+void _settings::_edit_escape(void)
 {
-	bool game_continues = false;
-	time++;
-
-	// For every key waiting in buffer...
-	int pressed_key;
-	while((pressed_key = getch()) != ERR)
+	printw("\n\tSet how long ESC waits for a key sequence (milliseconds, currently %d):", escape_delay);
+	escape_delay = -1;
+	for(; escape_delay<0;)
 	{
-		if(pressed_key == KEY_ESC) // End the game.
-			for(int i = 0; i<settings.players; i++)
-				alive[i]=false; // By killing all players.
-
-		// Pass the input to each player.
-		for(int i = 0; i<settings.players; i++)
-			players[i]->parse_input(pressed_key);
+		scanw("%d", &escape_delay);
 	}
-
-	// Checking for player-player collisions is realized by marking each player's position
-	// as an obstacle on the track.
-	if(settings.shared_track)
-		for(int i=0; i<settings.players; i++)
-			if(alive[i])
-				players[i]->mark_position();
-
-	for(int i=0; i<settings.players; i++)
-		if(alive[i])
-			if(settings.shared_track)
-			{
-				players[i]->unmark_position();
-				game_continues = (alive[i] = players[i]->tick(time)) || game_continues;
-				players[i]->mark_position();
-			}
-			else
-				// If the player dies it sets his alive status to false.
-				// If he lives, then there is a reason to continue the game.
-				game_continues = (alive[i] = players[i]->tick(time)) || game_continues;
-
-	if(settings.shared_track)
-		for(int i=0; i<settings.players; i++)
-			players[i]->unmark_position();
-
-	
-	// Results.
-	if(!game_continues)
-		message("Game finished after %d turns.", time);
-	
-	return game_continues;
 }
 
-game::game (void)
+void _settings::_edit_policy(void)
 {
-	// Initialize the RNG
-	// We have already a variable called "time", and we need a function of the same name.
-	// In order to circumvent this problem, we use the namespaces.
-	srand(std::time(NULL));
-	
-	// Initialize ncurses.
-	initscr();
-	// Initialize colors (refuse to start without them).
-	assert(has_colors());
-	start_color();
-	keypad(stdscr, TRUE);
-	cbreak();
-	noecho();
-	nonl();
-	nodelay(stdscr, true);
-
-	// Color palette.
-	init_pair(COLOR_BLACK, COLOR_BLACK, COLOR_BLACK);
-	init_pair(COLOR_RED, COLOR_RED, COLOR_BLACK);
-	init_pair(COLOR_GREEN, COLOR_GREEN, COLOR_BLACK);
-	init_pair(COLOR_YELLOW, COLOR_YELLOW, COLOR_BLACK);
-	init_pair(COLOR_BLUE, COLOR_BLUE, COLOR_BLACK);
-	init_pair(COLOR_MAGENTA, COLOR_MAGENTA, COLOR_BLACK);
-	init_pair(COLOR_CYAN, COLOR_CYAN, COLOR_BLACK);
-	init_pair(COLOR_WHITE, COLOR_WHITE, COLOR_BLACK);
-	init_pair(RESULTS_COLORS, COLOR_YELLOW, COLOR_BLUE);
-	
-	// Adjust settings, if needed.
-	if(settings.race_width == 0)
+	printw("\n\tShould several keys between two moves be Last wins, Accumulated or First wins? ");
+	char response = 0;
+	for(; response!='l' && response!='a' && response!='f';)
 	{
-		int y, x;
-		getmaxyx(stdscr, y, x);
-		settings.race_width = settings.vertical_split ? x/settings.players : x;
-	}
-	if(settings.minimal_width == 0)
-		settings.minimal_width = (int)(MINIMAL_WIDTH);
-	
-	// Prepare players
-	if(settings.shared_track)
-	{
-		track* course = new track();
-		for(int i = 0; i<settings.players; i++)
-			players[i]=new player_handler(i, course);
-	}
-	else
-		if(settings.similar_track)
-		{
-			track* course = new track();
-			for(int i = 0; i<settings.players; i++)
-				players[i]=new player_handler(i, course);
-		}
-		else
+		scanw("%c", &response);
+		response = tolower(response);
+		switch(response)
 		{
-			for(int i = 0; i<settings.players; i++)
-				players[i]=new player_handler(i, new track());
-		}
-	for(int i = 0; i<settings.players; i++)
-		alive[i]=true;
-
-	// Let the moves begin.
-	time = 0;
-}
-
-game::~game (void)
-{
-	echo();
-	nl();
-	nocbreak();
-	nodelay(stdscr, false);
-	endwin();
-}
-
-track::track (void)
-{
-	// Allocate the structures.
-	circuit.resize(settings.race_length);
-	for(vector<vector<char> >::iterator it = circuit.begin(); it!=circuit.end(); it++)
-		it->resize(settings.race_width);
-
-	// And create the course!
-	int borders[2];
-	int borders_directions[2]={0,0};
-
-	// Initially make the road halfway between minimal and maximal possible.
-	assert(settings.minimal_width <= settings.race_width);
-	borders[0] = (settings.race_width - settings.minimal_width)/4;
-	borders[1] = (settings.race_width*3 + settings.minimal_width)/4;
-
-	// And generate the lines.
-	for(int i=settings.race_length-1; 0<=i; i--)
-	{
-		// Put some background.
-		for(int j=0; j<(int)circuit[i].size(); j++)
-			circuit[i][j]=' ';
-		// Distance meter.
-		circuit[i][0]='0'+i%10;
-		// Occasional rock on the track :>
-		if(drand()<settings.rock_chance)
-			circuit[i][rand()%settings.race_width]='*';
-		// Move the kerbs.
-		borders[0]+=borders_directions[0];
-		borders[1]+=borders_directions[1];
-		// Draw the kerbs.
-		switch(borders_directions[0])
-		{// Different chars, depending on the kerb direction.
-			case 0:
-				circuit[i][borders[0]]='|';
+			case 'l':
+				command_policy = ZR_LAST_WINS;
 				break;
-			case 1:
-				circuit[i][borders[0]]='/';
+			case 'a':
+				command_policy = ZR_ACCUMULATE;
 				break;
-			case -1:
-				circuit[i][borders[0]]='\\';
-		}
-		switch(borders_directions[1])
-		{
-			case 0:
-				circuit[i][borders[1]]='|';
+			case 'f':
+				command_policy = ZR_FIRST_WINS;
 				break;
-			case 1:
-				circuit[i][borders[1]]='/';
-				break;
-			case -1:
-				circuit[i][borders[1]]='\\';
 		}
-
-
-		// Turn the kerbs...
-		int tries = 0; // This is in case it gets to narrow and no space at once (hangs).
-		while(
-				tries++<5 &&
-				(drand()<settings.turn_chance || // If RNG wants so,
-				borders[0]+borders_directions[0] == 0 // or no space.
-				))
-			borders_directions[0] = rand()%3-1;
-		if(borders[1]-borders[0] < settings.minimal_width) // If to narrow,
-			borders_directions[0] = -1; // Make it wider
-		// A sanity check.
-		if(borders[0]+borders_directions[0] == 0)
-			borders_directions[0] = 0;
-		// And the second one.
-		tries = 0;
-		while(
-				tries++<5 &&
-				(drand()<settings.turn_chance || // If RNG wants so,
-				borders[1]+borders_directions[1] == settings.race_width // or no space.
-				))
-			borders_directions[1]=rand()%3-1;
-		if(borders[1]-borders[0] < settings.minimal_width)
-			borders_directions[1] = 1;
-		if(borders[1]+borders_directions[1] == settings.race_width)
-			borders_directions[1] = 0;
 	}
 }
 
-void track::display(WINDOW* screen, int top_line)
+void _settings::_edit_minimap(void)
 {
-	// Get the geometry.
-	int screen_width, screen_height;
-	getmaxyx(screen, screen_height, screen_width);
-
-	// For every visible line...
-	for(int i = top_line; i<top_line+screen_height; i++)
-	{
-		// Move the cursor at it's beginning...
-		// Position at screen centre.
-		wmove(screen, i-top_line, (screen_width-settings.race_width)/2);
-		// And print all the characters.
-		for(int j=0; j<settings.race_width; j++)
-			waddch(screen, circuit[i][j]);
-	}
+	minimap = !minimap;
+	printw("\n\tThe minimap is %s now.\n", minimap ? "shown" : "hidden");
 }
 
-bool track::taken(int y, int x)
+void _settings::_edit_generator(void)
 {
-	return circuit[y][x]!=' ';
+	printw("\n\tChoose the track generator (currently %s):\n", zr_generator_name(generator));
+	for(int i = 0; i<ZR_GENERATORS; i++)
+		printw("\t%d) %s\n", i, zr_generator_name(i));
+	generator = -1;
+	// While outside the possible range.
+	for(; generator<0 || ZR_GENERATORS<=generator;)
+		generator = getch() - '0';
+	addch('\n');
 }
 
-void track::mark(int y, int x, car_image *car)
+void _settings::_edit_laps(void)
 {
-	vector<pair<int, int> > dots = car->get_dots();
-
-	for(unsigned int i=0; i<dots.size(); i++)
-		if(circuit[y+dots[i].first][x+dots[i].second] == ' ')
-			circuit[y+dots[i].first][x+dots[i].second] = settings.character;
+	printw("\n\tSet the number of laps (more than 1 makes a circuit, currently %d):", laps);
+	laps = 0;
+	// While outside the possible range.
+	for(; laps<1;)
+	{
+		scanw("%d", &laps);
+	}
 }
 
-void track::unmark(int y, int x, car_image *car)
+bool game::tick(void)
 {
-	vector<pair<int, int> > dots = car->get_dots();
-
-	for(unsigned int i=0; i<dots.size(); i++)
-		if(circuit[y+dots[i].first][x+dots[i].second] == settings.character)
-			circuit[y+dots[i].first][x+dots[i].second] = ' ';
+	if(!contest)
+	{
+		message("These settings don't make a race.");
+		return false;
+	}
 
-}
+	_input();
+	bool game_continues = contest->step() > 0;
 
-player_handler::player_handler(int position, track* racecourse)
-{
-	// Set the sizes for the windows.
-	// Height gets reused and thus is declared within class.
-	int screen_width;
-	getmaxyx(stdscr, screen_height, screen_width);
-	int width = settings.vertical_split? screen_width/settings.players : screen_width;
-	int height = settings.vertical_split? screen_height : screen_height/settings.players;
-	
-	// We can't set the track to be wider than the display.
-	assert(settings.race_width<=width);
-	
-	// Prepare screen part.
-	if(settings.vertical_split)
+	// Redraw whoever moved, then send the terminal what changed.
+	screen->draw(false);
+	if(screen->get_frame()->flush(shown, output ? (canvas*)output : terminal))
 	{
-		screen = newwin(
-				height, width,
-				// Take the corresponding vertical stripe.
-				0, width*(settings.players - position - 1)
-				);
+		refresh();
+		if(recorder)
+			recorder->frame((now() - start)/1e9);
 	}
-	else
+
+	// Results.
+	if(!game_continues && settings.laps > 1)
 	{
-		screen = newwin(
-				height, width,
-				// Take the corresponding horizontal stripe.
-				height*position, 0
-				);
+		// The best lap of every player, if there was any.
+		char best[MESSAGE_LENGTH] = "";
+		for(int i = 0; i<settings.players; i++)
+		{
+			const int* times = contest->get_lap_times(i);
+			int lap = 0;
+			for(int k = 0; k<contest->get_laps(i); k++)
+				if(!lap || times[k] - (k ? times[k-1] : 0) < lap)
+					lap = times[k] - (k ? times[k-1] : 0);
+			if(lap)
+				sprintf(best + strlen(best), " %d", lap);
+			else
+				strcat(best, " -");
+		}
+		message("Game finished after %d turns, best laps:%s.", contest->get_time(), best);
 	}
+	else if(!game_continues)
+		message("Game finished after %d turns.", contest->get_time());
 
-	// Just copy this pointer.
-	course = racecourse;
-
-	// And create an image for yourself
-	car = new car_image();
-
-	// Place the car at a reasonable place.
-	y = settings.race_length - settings.car_size;
-	if(settings.shared_track)
-		x = (settings.race_width - (settings.car_size+1)*(settings.players-2*position))/ 2;
-	else
-		x = settings.race_width/2;
+	return game_continues;
+}
 
-	// We want the car at the very bottom of the screen.
-	top_line = settings.race_length - height;
+void game::_input(void)
+{
+	// For every key waiting in buffer...
+	int pressed_key;
+	while((pressed_key = keyboard.get_key()) != ERR)
+	{
+		long long when = now();
 
-	// If not set, the player actually could freeze for a while.
-	last_move = -INF;
+		if(pressed_key == KEY_ESC) // End the game.
+			for(int i = 0; i<settings.players; i++)
+			{
+				contest->retire(i); // By taking out all players.
+				if(recording)
+					recording->retire(contest->get_time(), i);
+			}
 
-	// Copy the controls.
-	memcpy(controls, settings.controls[position], 4*sizeof(int));
-	// And make sure player doesn't take off.
-	command_y = command_x = 0;
+		// Pass the input to each player.
+		for(int i = 0; i<settings.players; i++)
+			players[i]->parse_input(pressed_key, when);
+	}
 }
 
-/*player_handler::~player_handler(void)
+void game::wait(void)
 {
-	// It's so simple...
-	delwin(screen);
-}*/
+	next_tick += settings.delay.tv_sec*1000000000LL + settings.delay.tv_nsec;
+	// A slow terminal made us late, don't try to catch up.
+	next_tick = max(next_tick, now());
 
-// Just a simple switched assignment.
-void player_handler::parse_input(int pressed_key)
-{
-	if(pressed_key == controls[0])
-		command_y=ACCELERATE;
-	if(pressed_key == controls[1])
-		command_y=BRAKE;
-	if(pressed_key == controls[2])
-		command_x=LEFT;
-	if(pressed_key == controls[3])
-		command_x=RIGHT;
+	while(now() < next_tick)
+	{
+		keyboard.wait(next_tick - now());
+		if(contest)
+			_input();
+	}
 }
 
-void player_handler::mark_position(void)
+game::game (void)
 {
-	course->mark(y, x, car);
-}
+	// Switch the terminal to racing. Colors are a must.
+	assert(has_colors());
+	simple_curses::race_mode();
+	next_tick = now();
 
-void player_handler::unmark_position(void)
-{
-	course->unmark(y, x, car);
+	// Adjust settings, if needed.
+	int screen_height, screen_width;
+	getmaxyx(stdscr, screen_height, screen_width);
+	zr_config config = settings;
+	// The minimap's size depends on the track's, near enough when that isn't known yet.
+	int map_columns = 0;
+	if(settings.minimap)
+		map_columns = minimap_columns(config.race_length, config.race_width ? config.race_width :
+				settings.vertical_split ? screen_width/settings.players : screen_width, screen_height);
+	// Zero means as wide as a player's part of the screen, wider tracks scroll.
+	int views_width = screen_width - map_columns;
+	if(config.race_width == 0)
+		config.race_width = settings.vertical_split ? views_width/settings.players : views_width;
+	// The speed depends on how much of the track the players see.
+	config.view_height = settings.vertical_split ? screen_height : screen_height/settings.players;
+
+	// Prepare the race and the players.
+	if(!resolve_config(&config))
+	{
+		contest = NULL;
+		return;
+	}
+	unsigned int seed = time(NULL);
+	contest = new race(&config, seed);
+
+	// Each race is recorded over the last one.
+	recording = NULL;
+	if(settings.replay_file)
+	{
+		recording = new replay_writer(settings.replay_file, &config, seed,
+				screen_height, screen_width, settings.vertical_split, map_columns,
+				settings.delay.tv_sec*1000000000LL + settings.delay.tv_nsec);
+		if(!recording->is_open())
+		{
+			delete recording;
+			recording = NULL;
+			message("Can't record the replay, the race goes on without it.");
+		}
+	}
+	recorder = NULL;
+	output = NULL;
+	if(settings.cast_file)
+	{
+		recorder = new cast_recorder(settings.cast_file, screen_height, screen_width);
+		if(!recorder->is_open())
+		{
+			delete recorder;
+			recorder = NULL;
+			message("Can't record the cast, the race goes on without it.");
+		}
+	}
+
+	for(int i = 0; i<settings.players; i++)
+		players[i] = new player_handler(i, contest, recording);
+
+	// The screen starts blank, and so does what we know it shows.
+	erase();
+	// A thread per view, as far as there are cores for them.
+	screen = new race_screen(contest, screen_height, screen_width, settings.vertical_split,
+			map_columns, min<long>(settings.players, sysconf(_SC_NPROCESSORS_ONLN)));
+	shown = new framebuffer(screen_height, screen_width);
+	terminal = new window_canvas(stdscr);
+	if(recorder)
+		output = new tee_canvas(terminal, recorder);
+	// Everything is drawn once, later frames only redraw what moved.
+	screen->draw(true);
+	start = now();
 }
 
-bool player_handler::tick(int time)
+game::~game (void)
 {
-	bool survive = true;
-	
-	// The higher the car on the screen, the faster it moves.
-	if(last_move + (y-top_line)/settings.speed_base < time)
+	if(contest)
 	{
-		last_move=time;
-		y--;
-		
-		// Watch to not segfault here.
-		top_line=max(0, top_line-1);
-		
-		// Handle commands
-		y+=command_y;
-		x+=command_x;
-		command_y = command_x = 0;
-
-		// Make sure he doesn't escape from the screen.
-		y = max(top_line, min(top_line + screen_height - settings.car_size, y));
-		
-		if(y <= 0) // Plain win
-			return false;
-
-		course->display(screen, top_line);
-		// Check for collisions.
-		for(int i=y; i<y+settings.car_size; i++)
-			for(int j=x; j<x+settings.car_size; j++)
-				if(course->taken(i, j) && car->collision_check(i-y, j-x))
-					survive=false;
-
-		if(survive)
-			car->display(screen, y-top_line, x);
-		else
-			car->explode(screen, y-top_line, x);
-		wrefresh(screen);
+		for(int i = 0; i<settings.players; i++)
+			delete players[i];
+		delete output;
+		delete recorder;
+		delete recording;
+		delete terminal;
+		delete shown;
+		delete screen;
+		delete contest;
 	}
-	
-	return survive;
+	// The next screen sets its own modes, curses itself stays up.
 }
 
-car_image::car_image(void)
+window_canvas::window_canvas(WINDOW* window)
 {
-	character = settings.character;
-	color = COLOR_YELLOW;
-	size = settings.car_size;
-
-	// The coolest part - drawing the damned thing	
-	_clear();
-	// Original key points were (0,0), (1,4), (2,0), (3,4) and (4,0).
-	// Now we just need to scale them and draw lines between.
-	_line(0, 0, 1*(size-1)/4, 4*(size-1)/4);
-	_line(1*(size-1)/4, 4*(size-1)/4, 2*(size-1)/4, 0);
-	_line(2*(size-1)/4, 0, 3*(size-1)/4, 4*(size-1)/4);
-	_line(3*(size-1)/4, 4*(size-1)/4, 4*(size-1)/4, 0);
+	screen = window;
 }
 
-void car_image::_clear(void)
+void window_canvas::get_size(int& height, int& width)
 {
-	// Simply clear the image
-	for(int i=0; i<size; i++)
-		for(int j=0; j<size; j++)
-			storage[i][j]=false;
+	getmaxyx(screen, height, width);
 }
 
-void car_image::display(WINDOW* screen, int y, int x)
+void window_canvas::put(int y, int x, char character, int color, bool bold)
 {
-	// We don't need to store this anywhere, so it can be set ad-hoc.
-
-	wattron(screen, COLOR_PAIR(color));
-	wattron(screen, A_BOLD);
-
-	for(int i=0; i<size; i++)
+	// Plain characters are the vast majority, don't touch attributes for them.
+	if(color == PALETTE_DEFAULT && !bold)
 	{
-		for(int j=0; j<size; j++)
-			if(storage[i][j])
-				mvwaddch(screen, y+i, x+j, character);
-				
+		mvwaddch(screen, y, x, character);
+		return;
 	}
 
+	wattron(screen, COLOR_PAIR(color));
+	if(bold)
+		wattron(screen, A_BOLD);
+	mvwaddch(screen, y, x, character);
 	// Restore the normal color for everything else...
 	wattroff(screen, COLOR_PAIR(color));
-	wattroff(screen, A_BOLD);
-}
-
-void car_image::explode(WINDOW* screen, int y, int x)
-{// Even in ASCII we can do cool explosions :>
-	for(int i=0; i<size; i++)
-	{
-		for(int j=0; j<size; j++)
-			if(rand()%2)
-			{
-				int color = rand()%7 + 1;
-				wattron(screen, COLOR_PAIR(color));
-				mvwaddch(screen, y+i, x+j, '*');
-				wattroff(screen, COLOR_PAIR(color));
-			}
-				
-	}
-	
+	if(bold)
+		wattroff(screen, A_BOLD);
 }
 
-bool car_image::collision_check(int y, int x)
+player_handler::player_handler(int position, race* racecourse, replay_writer* replay)
 {
-	return storage[y][x];
+	// Just copy these pointers.
+	contest = racecourse;
+	recording = replay;
+	index = position;
+
+	// Copy the controls.
+	memcpy(controls, settings.controls[position], 4*sizeof(int));
 }
 
-vector<pair<int, int> > car_image::get_dots(void)
+// Just a simple switched command.
+void player_handler::parse_input(int pressed_key, long long when)
 {
-	return dots;
+	if(pressed_key == controls[0])
+		_command(ACCELERATE, 0, when);
+	if(pressed_key == controls[1])
+		_command(BRAKE, 0, when);
+	if(pressed_key == controls[2])
+		_command(0, LEFT, when);
+	if(pressed_key == controls[3])
+		_command(0, RIGHT, when);
 }
 
-/*
- * This function is the heart of the original task for which this program
- * was created. It is based on the simple formula, that for a line between
- * (y1, x1) and (y2, x2) and a given coordinate x, the y coordinate for a
- * point on a line is y1 + (y2-y1) / ( (x2-x1)/(x-x1) ).
- */
-void car_image::_line(int y1, int x1, int y2, int x2)
+void player_handler::_command(int y, int x, long long when)
 {
-	// It can be given the other way round...
-	if(x2 < x1)
-	{
-		// So just swap the points.
-		int tmp = x1;
-		x1 = x2;
-		x2 = tmp;
-		// And swap the other coordinate.
-		tmp = y1;
-		y1 = y2;
-		y2 = tmp;
-	}
-	for(int i=x1; i<=x2; i++)
-	{
-		int y = y1 + (int)((float) (y2-y1)*(i-x1)/(x2-x1)+0.5);
-		// +0.5 is in order to do real rounding, not just truncation.
-		storage[y][i]=true;
-		dots.push_back(make_pair(y, i));
-	}
+	contest->command(index, y, x, when);
+	if(recording)
+		recording->command(contest->get_time(), index, y, x, when);
 }
+
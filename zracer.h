@@ -0,0 +1,290 @@
+/*
+ * Remigiusz Jan Andrzej Modrzejeski, http://lrem.net/ <lrem at go2.pl>
+ * Distributed under the GPL, for more details see:
+ * http://lrem.net/zracer.xhtml
+ *
+ * libzracer - the ZRacer simulation as a plain C library
+ *
+ * This is the only header external tools need. Everything is reached
+ * through opaque handles and all the queries write into buffers provided
+ * by the caller, so nothing here depends on the C++ runtime layout.
+ * Creating a track or a race allocates, stepping and querying it doesn't.
+ * For bindings that want to look at the data in place, the track and the
+ * car states can also be reached directly, see zr_track_data() and
+ * zr_race_create_in().
+ *
+ * The conventions are the same as in the game:
+ * 	- coordinates order is (y, x)
+ * 	- (0, 0) is upper left corner of everything
+ * 	- as a result, finish line is at line 0
+ */
+
+#ifndef ZRACER_H
+#define ZRACER_H
+
+#if defined(__GNUC__)
+#define ZR_API __attribute__((visibility("default")))
+#else
+#define ZR_API
+#endif
+
+// Bumped whenever a structure below changes its layout.
+#define ZR_API_VERSION 11
+
+// Car status values.
+#define ZR_RACING 0
+#define ZR_FINISHED 1
+#define ZR_CRASHED 2
+#define ZR_RETIRED 3
+
+/*
+ * What a car does with several commands given between two of its moves.
+ * A move goes a line and a column at most whatever the commands were,
+ * accumulated ones beyond that are kept for the moves after it.
+ */
+#define ZR_LAST_WINS 0
+#define ZR_ACCUMULATE 1
+#define ZR_FIRST_WINS 2
+
+// The track generators, see zr_generator_name() for what they're called.
+#define ZR_GENERATOR_CLASSIC 0
+#define ZR_GENERATOR_CURVES 1
+#define ZR_GENERATOR_CHICANES 2
+#define ZR_GENERATOR_TUNNELS 3
+#define ZR_GENERATOR_ROCK_FIELDS 4
+#define ZR_GENERATOR_SURFACES 5
+#define ZR_GENERATOR_TRAFFIC 6
+#define ZR_GENERATORS 7
+
+/*
+ * The layers of a track, what its cells are. Kerbs (with the distance
+ * meter), rocks, cars and movers (sliding rocks and crossing vehicles)
+ * are deadly, boost pads make a car move sooner, slow zones later. The
+ * finish is the top line. Movers are only there near the cars of a race.
+ */
+#define ZR_LAYER_KERB 0
+#define ZR_LAYER_ROCK 1
+#define ZR_LAYER_FINISH 2
+#define ZR_LAYER_BOOST 3
+#define ZR_LAYER_SLOW 4
+#define ZR_LAYER_CAR 5
+#define ZR_LAYER_MOVER 6
+#define ZR_LAYERS 7
+
+/*
+ * The sensor rays of a car, see zr_race_sense(). They start just off the
+ * car's square: sideways from the middle of its sides, forward from the
+ * middle of its top and diagonally from its top corners.
+ */
+#define ZR_RAY_LEFT 0
+#define ZR_RAY_FORWARD_LEFT 1
+#define ZR_RAY_FORWARD 2
+#define ZR_RAY_FORWARD_RIGHT 3
+#define ZR_RAY_RIGHT 4
+#define ZR_RAYS 5
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Everything needed to generate the tracks and run a race. Fill it with
+ * zr_config_default() and change what you need. Zero in race_width,
+ * minimal_width or view_height means "pick something reasonable".
+ */
+typedef struct zr_config
+{
+	// The sizes of the course, better make it bigger than the car ;)
+	int race_length, race_width;
+	// The minimal width of the road the players can drive.
+	int minimal_width;
+	// The number of participants.
+	int players;
+	// Character with which the cars are drawn.
+	char character;
+	// The size of the car.
+	int car_size;
+	// The distance interval at which the speed of the car changes.
+	int speed_base;
+	// The chance of generating a rock on a given line
+	double rock_chance;
+	// The chance of generating a turning on a given line
+	double turn_chance;
+	// Whether all players race on the same-looking racecourse.
+	int similar_track;
+	// Or maybe literally the same one? (Collisions possible)
+	int shared_track;
+	// How many lines of the track a player sees, the speed depends on it.
+	int view_height;
+	// One of ZR_LAST_WINS, ZR_ACCUMULATE or ZR_FIRST_WINS.
+	int command_policy;
+	// How the tracks are generated, one of ZR_GENERATOR_*.
+	int generator;
+	/*
+	 * How many times round the track the race goes. With more than one
+	 * the track is a circuit, its top joining its bottom, and the lines
+	 * of the race (car and view positions) go on past the track's
+	 * length: line y is row y % race_length of the track.
+	 */
+	int laps;
+} zr_config;
+
+/*
+ * The state of a single car. top_line is the top line of the track its
+ * player sees, last_move the time of its previous move, the commands are
+ * what the ones waiting for the next move add up to. moved is set when
+ * the car moved during the last step.
+ */
+typedef struct zr_car
+{
+	int y, x, top_line, last_move;
+	int command_y, command_x;
+	int status, finish_time, moved;
+} zr_car;
+
+// A command for a car, zero leaves the pending one as it is.
+typedef struct zr_command
+{
+	signed char y, x;
+} zr_command;
+
+// A character cell of a rendered frame, color is a curses color number.
+typedef struct zr_cell
+{
+	char character;
+	signed char color;
+	unsigned char bold, unused;
+} zr_cell;
+
+typedef struct zr_track zr_track;
+typedef struct zr_race zr_race;
+
+ZR_API int zr_api_version(void);
+ZR_API void zr_config_default(zr_config*);
+// The name of a track generator, or NULL if there's no such.
+ZR_API const char* zr_generator_name(int);
+
+/*
+ * A standalone track, generated from the config and the seed. Returns NULL
+ * if the config doesn't make sense, or there isn't the memory for it.
+ */
+ZR_API zr_track* zr_track_create(const zr_config*, unsigned int);
+ZR_API void zr_track_destroy(zr_track*);
+ZR_API int zr_track_length(const zr_track*);
+ZR_API int zr_track_width(const zr_track*);
+/*
+ * Copies count lines starting at the given one into the buffer, row after
+ * row, each zr_track_width() characters long. Returns the number of lines
+ * copied, or -1 when the buffer is too small.
+ */
+ZR_API int zr_track_rows(const zr_track*, int, int, char*, int);
+/*
+ * The whole track in place, zr_track_length() rows of zr_track_width()
+ * characters. The cars aren't in it, they're in the car layer.
+ */
+ZR_API const char* zr_track_data(const zr_track*);
+/*
+ * A layer of the track in place, zr_track_length() rows of
+ * zr_track_layer_words() 64 bit words, bit j%64 of word j/64 set when
+ * column j is on the layer. It's live: on a shared track the cars are
+ * marked in the car layer, and the movers move in theirs as the race
+ * goes. NULL if there's no such layer.
+ */
+ZR_API const unsigned long long* zr_track_layer(const zr_track*, int);
+ZR_API int zr_track_layer_words(const zr_track*);
+/*
+ * How many cells from the given line and column on, in the given
+ * direction (-1, 0 or 1 lines and columns per cell), are free of anything
+ * a car would hit, at most the range given last. The first one counts
+ * too. Outside of the track is taken, as it is for the cars.
+ */
+ZR_API int zr_track_ray(const zr_track*, int, int, int, int, int);
+/*
+ * How many lines from the given one up towards the finish have nothing
+ * a car would hit from the left to the right column (the next two), at
+ * most the range. On the open road it takes a step per 64 lines.
+ */
+ZR_API int zr_track_clearance(const zr_track*, int, int, int, int);
+
+/*
+ * A race between config->players cars. The tracks are generated from the
+ * seed according to the similar/shared settings. Returns NULL if the config
+ * doesn't make sense, or there isn't the memory for it.
+ */
+ZR_API zr_race* zr_race_create(const zr_config*, unsigned int);
+/*
+ * The same, but the race keeps its car states in the given buffer of
+ * config->players structures, which has to outlive it. This way many races
+ * can keep their cars in one array, readable at any time without copying.
+ */
+ZR_API zr_race* zr_race_create_in(const zr_config*, unsigned int, zr_car*);
+ZR_API void zr_race_destroy(zr_race*);
+/*
+ * Queues a command for a car, to be used up by its next move together with
+ * all the others given since its last one. The timestamp only orders them,
+ * in whatever unit the caller likes, so it has to grow.
+ */
+ZR_API void zr_race_command(zr_race*, int, zr_command, long long);
+/*
+ * Advances the race by one time unit. Commands may be NULL, otherwise they
+ * are one per car and queued the same way key presses are, stamped with
+ * the race time. Returns the number of cars still racing.
+ */
+ZR_API int zr_race_step(zr_race*, const zr_command*);
+/*
+ * Steps a number of races in one call. The commands, if given, are for
+ * all their cars one after another, race after race. Returns the number
+ * of cars still racing in all of them.
+ */
+ZR_API int zr_race_step_many(zr_race* const*, int, const zr_command*);
+/*
+ * Sets the number of threads the race's steps are worked out on, 1 by
+ * default. It only pays with hundreds of cars, and the race goes exactly
+ * the same however many there are. If they can't be had, it stays on one.
+ */
+ZR_API void zr_race_set_threads(zr_race*, int);
+// Takes a car out of the race, as if its player pressed ESC.
+ZR_API void zr_race_retire(zr_race*, int);
+ZR_API int zr_race_time(const zr_race*);
+ZR_API int zr_race_cars(const zr_race*);
+// Copies up to the given number of car states into the buffer, returns how many.
+ZR_API int zr_race_car_states(const zr_race*, zr_car*, int);
+/*
+ * Copies up to the given number of the times the car finished its laps
+ * at into the buffer, returns how many laps it has finished.
+ */
+ZR_API int zr_race_lap_times(const zr_race*, int, int*, int);
+/*
+ * Casts the ZR_RAYS sensor rays of a car, up to the given range, and
+ * writes how far each gets into the buffer, see zr_track_ray(). For an
+ * index with no car they're all 0.
+ */
+ZR_API void zr_race_sense(const zr_race*, int, int, int*);
+/*
+ * The same for all the cars of a number of races, one after another,
+ * race after race, ZR_RAYS distances for each.
+ */
+ZR_API void zr_race_sense_many(zr_race* const*, int, int, int*);
+// The track the given car drives on, owned by the race.
+ZR_API const zr_track* zr_race_track(const zr_race*, int);
+
+/*
+ * Renders the race into a height x width frame of cells, split between the
+ * players (vertically if the flag is set) exactly like the game does on
+ * the terminal. Unless full is set, only the views of the cars that moved
+ * in the last step are redrawn, the rest of the frame is left as it was.
+ * Returns the number of views drawn, or -1 if there wasn't the memory.
+ */
+ZR_API int zr_race_render(zr_race*, zr_cell*, int, int, int, int);
+/*
+ * Renders height lines of a track starting at the given one, centred in
+ * a height x width frame, or just its middle if it's wider than that.
+ * Without the memory for it the frame may be left blank.
+ */
+ZR_API void zr_track_render(const zr_track*, zr_cell*, int, int, int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif